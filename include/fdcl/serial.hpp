@@ -8,8 +8,10 @@
 #include <stdio.h>
 
 #include "Eigen/Dense"
+#include "Eigen/Sparse"
 
 #define MAX_BUFFER_RECV_SIZE 8192
+#define MAX_UNPACK_DIM 16777216  // maximum rows or cols of an unpacked matrix
 
 namespace fdcl 
 {
@@ -18,6 +20,10 @@ namespace fdcl
 *
 *  This library provides a tool to save variables into a binary buffer or
 *  read variables from a binary buffer.
+*
+*  Unpacking never reads past the received data. If there are not enough
+*  bytes left, an error is printed, the variable is left unchanged, and the
+*  rest of the buffer is skipped.
 */
 class serial
 {
@@ -46,6 +52,28 @@ public:
     void init(unsigned char* buf_received, int size);
 
 
+    /** \fn void view(unsigned char* buf_received, int size)
+     * Points the buffer to the received data without copying it, so that it
+     * can be unpacked in place. The received data must stay valid until
+     * unpacking is done. Calling clear() or init() drops the view.
+     * @param buf_received received buffer
+     * @param size         size of the received buffer
+     */
+    void view(unsigned char* buf_received, int size);
+
+
+    /** \fn void attach(unsigned char* buf_out, int capacity)
+     * Packs into the given memory instead of the internal buffer, e.g., a
+     * shared memory slot, so that the packed data does not need to be copied.
+     * size() and data() refer to the given memory until clear() or init() is
+     * called. If the packed data does not fit, an error is printed, the
+     * rest is dropped, and overflow() returns true.
+     * @param buf_out  memory to pack into
+     * @param capacity size of the memory
+     */
+    void attach(unsigned char* buf_out, int capacity);
+
+
     /** \fn void reserve(int size)
      * Reserves size
      * @param size amount of size required to reserve
@@ -54,19 +82,30 @@ public:
 
 
     /** \fn int size()
-     * Returns the size of the buffer
+     * Returns the size of the buffer, or of the viewed or attached memory if
+     * there is one
      * @return size of the buffer
      */
     int size();
 
 
     /** \fn unsigned char* data()
-     * Returns the buffer data
+     * Returns the buffer data, or the viewed or attached memory if there is
+     * one
      * @return buffer data
      */
     unsigned char* data();
 
 
+    /** \fn bool overflow()
+     * Returns true if data packed into the attached memory did not fit and
+     * was dropped, in which case the packed message is incomplete. It is
+     * reset by attach(), clear() and init().
+     * @return true if the attached memory overflowed
+     */
+    bool overflow();
+
+
     /** \fn void pack(int &i)
     * Packs an int into the buffer
     * @param i int to be packed
@@ -113,6 +152,136 @@ public:
     void pack_as_float(Eigen::MatrixBase<Derived> &M);
 
 
+    /** \fn void pack_as_half(float &f)
+     * Packs a float into the buffer as an IEEE 754 half precision number
+     * (2 bytes), rounded to the nearest even. Values larger than 65504 become
+     * inf. F16C instructions are used if the CPU supports them.
+     * @param f float to be packed
+     */
+    void pack_as_half(float &f);
+
+
+    /** \fn void pack_as_half(double &d)
+     * Packs a double into the buffer as a half precision number, rounded to
+     * the nearest even. As F16C does not convert doubles directly, the value
+     * is first narrowed to a float with round to odd, which keeps the final
+     * rounding correct.
+     * @param d double to be packed
+     */
+    void pack_as_half(double &d);
+
+
+    /** \fn void pack_as_half(Eigen::MatrixBase<Derived> &M)
+     * Packs an Eigen float or double matrix into the buffer as half precision
+     * numbers. This halves the size of pack_as_float for data such as IMU
+     * measurements or image features, where about three significant digits
+     * are enough.
+     * @param M Eigen::MatrixBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_as_half(Eigen::MatrixBase<Derived> &M);
+
+
+    /** \fn void pack_as_bfloat16(float &f)
+     * Packs a float into the buffer as a bfloat16 number (2 bytes), which
+     * keeps the range of a float with about two significant digits. The value
+     * is rounded to the nearest even.
+     * @param f float to be packed
+     */
+    void pack_as_bfloat16(float &f);
+
+
+    /** \fn void pack_as_bfloat16(double &d)
+     * Packs a double into the buffer as a bfloat16 number, rounded to the
+     * nearest even through a float narrowed with round to odd
+     * @param d double to be packed
+     */
+    void pack_as_bfloat16(double &d);
+
+
+    /** \fn void pack_as_bfloat16(Eigen::MatrixBase<Derived> &M)
+     * Packs an Eigen float or double matrix into the buffer as bfloat16
+     * numbers
+     * @param M Eigen::MatrixBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_as_bfloat16(Eigen::MatrixBase<Derived> &M);
+
+
+    /** \fn void pack_dynamic(Eigen::MatrixBase<Derived> &M)
+     * Packs an Eigen matrix of any size, e.g., Eigen::MatrixXd or
+     * Eigen::VectorXd, with its number of rows and columns as varints followed
+     * by the values as in pack(). The receiver does not need to know the size.
+     * @param M Eigen::MatrixBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_dynamic(Eigen::MatrixBase<Derived> &M);
+
+
+    /** \fn void pack_native(Eigen::PlainObjectBase<Derived> &M)
+     * Packs a column major Eigen float or double matrix of any size with its
+     * dimensions, and its values copied as they are in memory. The values are
+     * aligned to their size from the beginning of the buffer, so that the
+     * receiver can map them in place with map_native(). This is only for
+     * hosts with the same byte order and floating point format, e.g., through
+     * fdcl::serial_shm.
+     * @param M Eigen::PlainObjectBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_native(Eigen::PlainObjectBase<Derived> &M);
+
+
+    /** \fn void pack_symmetric(Eigen::MatrixBase<Derived> &M)
+     * Packs only the upper triangle of a symmetric (self-adjoint) Eigen
+     * matrix, row by row. For an n x n matrix, n(n+1)/2 values are packed,
+     * e.g., a 15x15 double covariance takes 960 bytes instead of 1800.
+     * @param M square Eigen::MatrixBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_symmetric(Eigen::MatrixBase<Derived> &M);
+
+
+    /** \fn void pack_diagonal(Eigen::MatrixBase<Derived> &M)
+     * Packs only the diagonal of a square Eigen matrix.
+     * @param M square Eigen::MatrixBase<Derived> to be packed
+     */
+    template<typename Derived>
+    void pack_diagonal(Eigen::MatrixBase<Derived> &M);
+
+
+    /** \fn void pack(Eigen::SparseMatrix<double> &S)
+     * Packs a sparse matrix in compressed sparse row (CSR) form. The number
+     * of rows, columns, and non-zeros, the number of non-zeros in each row,
+     * and the delta-coded column indices are packed as varints, and each
+     * value is packed as a double.
+     * @param S Eigen::SparseMatrix<double> to be packed
+     */
+    void pack(Eigen::SparseMatrix<double> &S);
+
+
+    /** \fn void pack(Eigen::Quaterniond &q)
+     * Packs a quaternion as four doubles in the order of w, x, y, z
+     * @param q Eigen::Quaterniond to be packed
+     */
+    void pack(Eigen::Quaterniond &q);
+
+
+    /** \fn void pack_rotation(Eigen::Matrix3d &R)
+     * Packs a rotation matrix as its rotation vector, i.e., angle times the
+     * unit axis, which is three doubles.
+     * @param R rotation matrix to be packed
+     */
+    void pack_rotation(Eigen::Matrix3d &R);
+
+
+    /** \fn void pack_rotation(Eigen::Quaterniond &q)
+     * Packs a unit quaternion as its rotation vector, which is three doubles.
+     * The wire format is the same as pack_rotation(Eigen::Matrix3d &R).
+     * @param q unit quaternion to be packed
+     */
+    void pack_rotation(Eigen::Quaterniond &q);
+
+
     /** \fn void unpack(int &i)
     * Unpacks an int from the buffer
     * @param i int to be unpacked
@@ -158,7 +327,161 @@ public:
     void unpack_as_double(Eigen::MatrixBase<Derived>& M);
 
 
+    /** \fn void unpack_half(float &f)
+    * Unpacks a half precision number packed with pack_as_half into a float
+    * @param f float to be unpacked
+    */
+    void unpack_half(float &f);
+
+
+    /** \fn void unpack_half(double &d)
+    * Unpacks a half precision number packed with pack_as_half into a double
+    * @param d double to be unpacked
+    */
+    void unpack_half(double &d);
+
+
+    /** \fn void unpack_half(Eigen::MatrixBase<Derived> &M)
+    * Unpacks half precision numbers packed with pack_as_half into an Eigen
+    * float or double matrix
+    * @param M Eigen::MatrixBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_half(Eigen::MatrixBase<Derived>& M);
+
+
+    /** \fn void unpack_bfloat16(float &f)
+    * Unpacks a bfloat16 number packed with pack_as_bfloat16 into a float
+    * @param f float to be unpacked
+    */
+    void unpack_bfloat16(float &f);
+
+
+    /** \fn void unpack_bfloat16(double &d)
+    * Unpacks a bfloat16 number packed with pack_as_bfloat16 into a double
+    * @param d double to be unpacked
+    */
+    void unpack_bfloat16(double &d);
+
+
+    /** \fn void unpack_bfloat16(Eigen::MatrixBase<Derived> &M)
+    * Unpacks bfloat16 numbers packed with pack_as_bfloat16 into an Eigen
+    * float or double matrix
+    * @param M Eigen::MatrixBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_bfloat16(Eigen::MatrixBase<Derived>& M);
+
+
+    /** \fn void unpack_dynamic(Eigen::PlainObjectBase<Derived> &M)
+    * Unpacks a matrix packed with pack_dynamic, and resizes M to the packed
+    * size. Eigen only reallocates M when its number of elements changes, so
+    * reusing M for messages of the same size does not allocate.
+    * @param M Eigen::PlainObjectBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_dynamic(Eigen::PlainObjectBase<Derived>& M);
+
+
+    /** \fn Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+    *       unpack_dynamic(std::vector<Scalar> &storage)
+    * Unpacks a matrix packed with pack_dynamic into the given storage, which
+    * only grows when its capacity is not enough, so that messages of varying
+    * size do not allocate once the largest one is received
+    * @param storage storage for the values, reused across messages
+    * @return matrix mapped over storage, which is empty on error
+    */
+    template<typename Scalar>
+    Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+        unpack_dynamic(std::vector<Scalar>& storage);
+
+
+    /** \fn void unpack_native(Eigen::PlainObjectBase<Derived> &M)
+    * Unpacks a matrix packed with pack_native by copying it into M, which is
+    * resized as in unpack_dynamic
+    * @param M Eigen::PlainObjectBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_native(Eigen::PlainObjectBase<Derived>& M);
+
+
+    /** \fn Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+    *       map_native()
+    * Maps a matrix packed with pack_native straight over the received bytes
+    * without copying, e.g., buf.map_native<double>(). The map is only valid
+    * while the received data is, and is empty on error. If the received
+    * data is not aligned to Scalar, the map is empty and the matrix is not
+    * consumed, so that it can be copied with unpack_native() instead.
+    * @return matrix mapped over the received bytes
+    */
+    template<typename Scalar>
+    Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+        map_native();
+
+
+    /** \fn void unpack_symmetric(Eigen::MatrixBase<Derived> &M)
+    * Unpacks the upper triangle packed with pack_symmetric, and mirrors it to
+    * the lower triangle
+    * @param M square Eigen::MatrixBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_symmetric(Eigen::MatrixBase<Derived>& M);
+
+
+    /** \fn void unpack_diagonal(Eigen::MatrixBase<Derived> &M)
+    * Unpacks the diagonal packed with pack_diagonal. The off-diagonal terms
+    * are set to zero.
+    * @param M square Eigen::MatrixBase<Derived> to be unpacked
+    */
+    template<typename Derived>
+    void unpack_diagonal(Eigen::MatrixBase<Derived>& M);
+
+
+    /** \fn void unpack(Eigen::SparseMatrix<double> &S)
+    * Unpacks a sparse matrix packed with pack(Eigen::SparseMatrix<double>&).
+    * The matrix is resized to the packed dimensions.
+    * @param S Eigen::SparseMatrix<double> to be unpacked
+    */
+    void unpack(Eigen::SparseMatrix<double> &S);
+
+
+    /** \fn void unpack(Eigen::Quaterniond &q)
+    * Unpacks a quaternion from the buffer
+    * @param q Eigen::Quaterniond to be unpacked
+    */
+    void unpack(Eigen::Quaterniond &q);
+
+
+    /** \fn void unpack_rotation(Eigen::Matrix3d &R)
+    * Unpacks a rotation vector packed with pack_rotation into a rotation
+    * matrix
+    * @param R rotation matrix to be unpacked
+    */
+    void unpack_rotation(Eigen::Matrix3d &R);
+
+
+    /** \fn void unpack_rotation(Eigen::Quaterniond &q)
+    * Unpacks a rotation vector packed with pack_rotation into a unit
+    * quaternion
+    * @param q unit quaternion to be unpacked
+    */
+    void unpack_rotation(Eigen::Quaterniond &q);
+
+
 private:
+    unsigned char* ext_buf; // memory given to view() or attach(), or NULL
+    unsigned int ext_size;
+    unsigned int ext_capacity;
+    bool ext_overflow; // packing into the attached memory dropped data
+
+    unsigned char* rdata();
+
+    // appends packed bytes to the buffer or the attached memory
+    void append(const unsigned char* data, unsigned int n);
+
+    // checks the next n bytes can be unpacked, and prints an error otherwise
+    bool check_size(unsigned long long int n, const char* fn);
+
     // the following functions are copied from
     // http://beej.us/guide/bgnet/html/multi/advanced.html#serialization
     unsigned long long int pack754(long double f, unsigned bits,
@@ -174,6 +497,31 @@ private:
     unsigned long int unpacku32(unsigned char *buf);
     long long int unpacki64(unsigned char *buf);
     unsigned long long int unpacku64(unsigned char *buf);
+
+    // float <-> half precision and bfloat16, rounded to the nearest even
+    unsigned int float_to_half(float f);
+    float half_to_float(unsigned int h);
+    unsigned int float_to_bfloat16(float f);
+    float bfloat16_to_float(unsigned int h);
+
+    // narrows a double to a float with round to odd, so that rounding the
+    // float to 16 bits gives the same result as rounding the double directly
+    float narrow_to_odd(double d);
+    float narrow_to_odd(float f);
+
+    // LEB128 varints, used for sizes and indices
+    void packvarint(unsigned long long int i);
+    unsigned long long int unpackvarint();
+
+    // dimension header of pack_dynamic and pack_native
+    bool unpack_dims(int &rows, int &cols, int rows_fixed, int cols_fixed,
+        unsigned int elem_size, const char* fn);
+    bool unpack_native_header(unsigned int elem_size, const char* fn);
+    unsigned char native_tag(unsigned int elem_size);
+
+    // rotation vector <-> rotation
+    void pack_rotvec(const Eigen::AngleAxisd &aa);
+    Eigen::AngleAxisd unpack_rotvec();
 };  // end of serial class
 
 }  // end of namespace fdcl
@@ -0,0 +1,164 @@
+#ifndef FDCL_SERIAL_RECEIVER_HPP
+#define FDCL_SERIAL_RECEIVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "fdcl/serial.hpp"
+
+namespace fdcl
+{
+
+/** \brief batched UDP receive and decode pipeline
+*
+*  Datagrams are received in batches with recvmmsg into a preallocated slab of
+*  fixed-size slots. Each datagram is handed to a worker thread as a zero-copy
+*  fdcl::serial view, so the handler unpacks straight from the slab. Datagrams
+*  from the same source address and port are always dispatched to the same
+*  worker, so they are unpacked in the order they were received.
+*
+*  This class is only available on Linux.
+*/
+class serial_receiver
+{
+public:
+    /** handler called on a worker thread for each received datagram, the
+     *  serial buffer is only valid until the handler returns
+     */
+    typedef std::function<void(const sockaddr_in &from, fdcl::serial &buf)>
+        handler;
+
+
+    /** \brief counters and queue depths of the pipeline stages */
+    struct stats
+    {
+        unsigned long long int received; /**< datagrams received */
+        unsigned long long int batches; /**< recvmmsg calls with data */
+        unsigned long long int truncated; /**< datagrams larger than a slot,
+                                           *  which are discarded
+                                           */
+        unsigned long long int dropped; /**< datagrams dropped by the kernel
+                                         *  because the socket buffer was full
+                                         */
+        unsigned int slots_in_flight; /**< slots waiting for or being
+                                       *  unpacked by a worker
+                                       */
+        unsigned int slots_in_flight_max; /**< maximum of slots_in_flight */
+        std::vector<unsigned int> queue_depth; /**< current depth of each
+                                                *  worker queue
+                                                */
+        std::vector<unsigned int> queue_depth_max; /**< maximum depth of each
+                                                    *  worker queue
+                                                    */
+        std::vector<unsigned long long int> processed; /**< datagrams unpacked
+                                                        *  by each worker
+                                                        */
+    };
+
+
+    serial_receiver();
+    ~serial_receiver();
+
+
+    /** \fn bool open(int port, int num_workers, handler h, int num_slots,
+     *      int slot_size, int batch, int rcvbuf)
+     * Binds a UDP socket and starts the receiver and worker threads
+     * @param port        UDP port to bind, 0 for an ephemeral port
+     * @param num_workers number of worker threads
+     * @param h           handler called for each datagram
+     * @param num_slots   number of slots in the slab
+     * @param slot_size   size of each slot, larger datagrams are discarded
+     * @param batch       maximum number of datagrams per recvmmsg call
+     * @param rcvbuf      socket receive buffer size, 0 to keep the default
+     * @return true if the socket is bound and the threads are started, false
+     *         if it fails or num_slots, slot_size or batch is not positive
+     */
+    bool open(int port, int num_workers, handler h, int num_slots = 4096,
+        int slot_size = MAX_BUFFER_RECV_SIZE, int batch = 64,
+        int rcvbuf = 0);
+
+
+    /** \fn void close()
+     * Stops the threads after the queued datagrams are unpacked, and closes
+     * the socket
+     */
+    void close();
+
+
+    /** \fn int port()
+     * Returns the bound UDP port
+     * @return bound port, or -1 if the socket is not open
+     */
+    int port();
+
+
+    /** \fn stats get_stats()
+     * Returns a snapshot of the pipeline counters and queue depths
+     * @return pipeline stats
+     */
+    stats get_stats();
+
+
+    /** \fn static int worker_of(const sockaddr_in &from, int num_workers)
+     * Returns the worker that unpacks the datagrams from a source. Sources
+     * that differ only in their address or only in their port are spread
+     * evenly over the workers.
+     * @param from        source address and port
+     * @param num_workers number of worker threads
+     * @return index of the worker
+     */
+    static int worker_of(const sockaddr_in &from, int num_workers);
+
+
+private:
+    struct worker
+    {
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<int> queue;  // slot indices to be unpacked
+        std::atomic<unsigned int> depth;
+        std::atomic<unsigned int> depth_max;
+        std::atomic<unsigned long long int> processed;
+    };
+
+    int fd;
+    std::atomic<bool> running;
+    handler h;
+
+    int num_slots;
+    int slot_size;
+    int batch;
+    std::vector<unsigned char> slab;
+    std::vector<int> slot_len;
+    std::vector<sockaddr_in> slot_from;
+
+    std::mutex free_mtx;
+    std::condition_variable free_cv;
+    std::vector<int> free_slots;
+
+    std::thread receiver;
+    std::vector< std::unique_ptr<worker> > workers;
+
+    std::atomic<unsigned long long int> received;
+    std::atomic<unsigned long long int> batches;
+    std::atomic<unsigned long long int> truncated;
+    std::atomic<unsigned long long int> dropped;
+    std::atomic<unsigned int> in_flight;
+    std::atomic<unsigned int> in_flight_max;
+
+    void receive_loop();
+    void work_loop(worker &w);
+    static void update_max(std::atomic<unsigned int> &max, unsigned int v);
+};  // end of serial_receiver class
+
+}  // end of namespace fdcl
+#endif
@@ -0,0 +1,146 @@
+#ifndef FDCL_SERIAL_SHM_HPP
+#define FDCL_SERIAL_SHM_HPP
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#include "fdcl/serial.hpp"
+
+namespace fdcl
+{
+
+/** \brief shared memory transport for processes on the same host
+*
+*  A POSIX shared memory object holds a ring of fixed-size slots. A writer
+*  packs straight into the next slot through fdcl::serial::attach() and
+*  publishes it, and every reader unpacks it in place through
+*  fdcl::serial::view(). Readers spin briefly and then sleep on a futex, so an
+*  idle reader does not use the CPU.
+*
+*  The ring is a broadcast: each reader sees every message, and a writer never
+*  waits for readers. A reader that falls more than a ring behind skips the
+*  overwritten messages, which are counted in lost().
+*
+*  Any number of processes can open the same ring by its name. Messages of
+*  one writer are read in order. Several writers may share a ring, as long as
+*  fewer than the number of slots are being packed at the same time.
+*
+*  This class is only available on Linux.
+*/
+class serial_shm
+{
+public:
+    serial_shm();
+    ~serial_shm();
+
+
+    /** \fn bool open(const std::string &name, int num_slots, int slot_size)
+     * Opens the ring with the given name, and creates it if it does not
+     * exist. All processes must use the same number and size of slots. A
+     * reader only receives the messages published after it opens the ring.
+     * @param name      name of the shared memory object, e.g., "/fdcl_imu"
+     * @param num_slots number of slots in the ring
+     * @param slot_size maximum size of a message in bytes
+     * @return true if the ring is opened
+     */
+    bool open(const std::string &name, int num_slots = 64,
+        int slot_size = MAX_BUFFER_RECV_SIZE);
+
+
+    /** \fn void close()
+     * Unmaps the ring. The shared memory object remains until unlink().
+     */
+    void close();
+
+
+    /** \fn static void unlink(const std::string &name)
+     * Removes the shared memory object with the given name
+     * @param name name of the shared memory object
+     */
+    static void unlink(const std::string &name);
+
+
+    /** \fn void claim(fdcl::serial &buf)
+     * Claims the next slot for writing, and attaches buf to it so that
+     * packing writes straight into shared memory
+     * @param buf serial buffer to pack with
+     */
+    void claim(fdcl::serial &buf);
+
+
+    /** \fn bool publish(fdcl::serial &buf)
+     * Publishes the slot claimed with claim(), with the size packed in buf,
+     * and wakes up sleeping readers. If the message did not fit in the slot,
+     * it is dropped and readers skip it.
+     * @param buf serial buffer attached by claim()
+     * @return false if the message was larger than the slot and is dropped
+     */
+    bool publish(fdcl::serial &buf);
+
+
+    /** \fn bool read(fdcl::serial &buf, int timeout_ms)
+     * Waits for the next message, and points buf to it in shared memory. The
+     * message must be released with release() after unpacking.
+     * @param buf        serial buffer to unpack with
+     * @param timeout_ms time to wait in milliseconds, or -1 to wait forever
+     * @return true if there is a message, false on timeout
+     */
+    bool read(fdcl::serial &buf, int timeout_ms = -1);
+
+
+    /** \fn bool release()
+     * Releases the message returned by read(), and moves to the next one
+     * @return false if a writer overwrote the message while it was being
+     *         unpacked, in which case the unpacked values must be discarded
+     */
+    bool release();
+
+
+    /** \fn unsigned long long int lost()
+     * Returns the number of messages skipped by this reader because they were
+     * overwritten before they were read, or dropped by publish()
+     * @return number of lost messages
+     */
+    unsigned long long int lost();
+
+
+    int spin; /**< number of polls before a reader sleeps on the futex, 0 to
+               *  sleep right away, which is the default on a single core
+               */
+
+
+private:
+    struct header
+    {
+        uint32_t magic;
+        uint32_t num_slots;
+        uint32_t slot_size;
+        std::atomic<uint32_t> futex;  // incremented on every publish
+        std::atomic<uint32_t> waiters;  // readers sleeping on the futex
+        std::atomic<uint64_t> head;  // sequence number of the next claim
+    };
+
+    struct slot
+    {
+        // 2n + 1 while message n is packed, 2n + 2 once it is published
+        std::atomic<uint64_t> seq;
+        uint32_t size;
+    };
+
+    int fd;
+    unsigned char *mem;
+    size_t mem_size;
+    header *hdr;
+    size_t stride;
+
+    uint64_t claimed;  // sequence number claimed by this writer
+    uint64_t next;  // sequence number to be read by this reader
+    unsigned long long int num_lost;
+
+    slot *slot_at(uint64_t n);
+    unsigned char *data_at(uint64_t n);
+};  // end of serial_shm class
+
+}  // end of namespace fdcl
+#endif
@@ -0,0 +1,245 @@
+// Latency of exchanging fdcl::serial messages between two processes through
+// fdcl::serial_shm, compared with UDP over loopback.
+//
+// The parent sends a message, and the forked child unpacks it and sends it
+// back. Half of the round trip time is reported as the one-way latency.
+//
+// Usage: bench_serial_shm [iterations]
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Eigen/Dense"
+
+#include "fdcl/serial.hpp"
+#include "fdcl/serial_shm.hpp"
+
+
+typedef Eigen::Matrix<double, 15, 15> matrix_t;
+
+
+// a state estimate: sequence number, time, state and covariance
+void pack_message(fdcl::serial &buf, int seq, matrix_t &P)
+{
+	double t = seq * 0.01;
+	Eigen::Matrix<double, 15, 1> x = P.col(0);
+
+	buf.pack(seq);
+	buf.pack(t);
+	buf.pack(x);
+	buf.pack_symmetric(P);
+}
+
+
+int unpack_message(fdcl::serial &buf, matrix_t &P)
+{
+	int seq;
+	double t;
+	Eigen::Matrix<double, 15, 1> x;
+
+	buf.unpack(seq);
+	buf.unpack(t);
+	buf.unpack(x);
+	buf.unpack_symmetric(P);
+
+	return seq;
+}
+
+
+void report(const std::string &name, std::vector<double> &rtt)
+{
+	std::sort(rtt.begin(), rtt.end());
+
+	std::cout << std::setw(14) << std::left << name << std::right
+	          << std::fixed << std::setprecision(3)
+	          << std::setw(10) << rtt[rtt.size() / 2] / 2.0 * 1e6
+	          << std::setw(10) << rtt[rtt.size() * 99 / 100] / 2.0 * 1e6
+	          << std::endl;
+}
+
+
+int run_shm(const std::string &name, int spin, int iterations,
+	std::vector<double> &rtt)
+{
+	const std::string ping_name = "/fdcl_bench_ping";
+	const std::string pong_name = "/fdcl_bench_pong";
+	fdcl::serial_shm ping, pong;
+	fdcl::serial buf;
+	matrix_t P, P_recv;
+	int errors = 0;
+
+	P.setRandom();
+	P = (P + P.transpose()).eval();
+
+	fdcl::serial_shm::unlink(ping_name);
+	fdcl::serial_shm::unlink(pong_name);
+
+	// both ends are opened before the fork, so no message is missed
+	if (!ping.open(ping_name, 16, 2048) || !pong.open(pong_name, 16, 2048))
+	{
+		return 1;
+	}
+	ping.spin = spin;
+	pong.spin = spin;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		for(int k = 0; k < iterations; k++)
+		{
+			ping.read(buf);
+			int seq = unpack_message(buf, P_recv);
+			ping.release();
+
+			pong.claim(buf);
+			pack_message(buf, seq, P_recv);
+			pong.publish(buf);
+		}
+		_exit(0);
+	}
+
+	for(int k = 0; k < iterations; k++)
+	{
+		std::chrono::steady_clock::time_point t0 =
+			std::chrono::steady_clock::now();
+
+		ping.claim(buf);
+		pack_message(buf, k, P);
+		ping.publish(buf);
+
+		pong.read(buf);
+		int seq = unpack_message(buf, P_recv);
+		if (!pong.release() || seq != k || P_recv != P) errors++;
+
+		rtt.push_back(std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - t0).count());
+	}
+
+	waitpid(pid, NULL, 0);
+	fdcl::serial_shm::unlink(ping_name);
+	fdcl::serial_shm::unlink(pong_name);
+
+	report(name, rtt);
+	return errors;
+}
+
+
+int bind_loopback(sockaddr_in &addr)
+{
+	socklen_t len = sizeof(addr);
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	bind(fd, (sockaddr*) &addr, sizeof(addr));
+	getsockname(fd, (sockaddr*) &addr, &len);
+
+	return fd;
+}
+
+
+int run_udp(const std::string &name, int iterations, std::vector<double> &rtt)
+{
+	sockaddr_in parent_addr, child_addr;
+	int parent_fd = bind_loopback(parent_addr);
+	int child_fd = bind_loopback(child_addr);
+	unsigned char buf_received[MAX_BUFFER_RECV_SIZE];
+	fdcl::serial buf;
+	matrix_t P, P_recv;
+	int errors = 0;
+
+	P.setRandom();
+	P = (P + P.transpose()).eval();
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		for(int k = 0; k < iterations; k++)
+		{
+			int n = recv(child_fd, buf_received, sizeof(buf_received), 0);
+			buf.init(buf_received, n);
+			int seq = unpack_message(buf, P_recv);
+
+			buf.clear();
+			pack_message(buf, seq, P_recv);
+			sendto(child_fd, buf.data(), buf.size(), 0,
+				(sockaddr*) &parent_addr, sizeof(parent_addr));
+		}
+		_exit(0);
+	}
+
+	buf.reserve(MAX_BUFFER_RECV_SIZE);
+	for(int k = 0; k < iterations; k++)
+	{
+		std::chrono::steady_clock::time_point t0 =
+			std::chrono::steady_clock::now();
+
+		buf.clear();
+		pack_message(buf, k, P);
+		sendto(parent_fd, buf.data(), buf.size(), 0,
+			(sockaddr*) &child_addr, sizeof(child_addr));
+
+		int n = recv(parent_fd, buf_received, sizeof(buf_received), 0);
+		buf.init(buf_received, n);
+		int seq = unpack_message(buf, P_recv);
+		if (seq != k || P_recv != P) errors++;
+
+		rtt.push_back(std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - t0).count());
+	}
+
+	waitpid(pid, NULL, 0);
+	close(parent_fd);
+	close(child_fd);
+
+	report(name, rtt);
+	return errors;
+}
+
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+	int errors = 0;
+	std::vector<double> rtt;
+
+	// pack(int) is 16 bits, so the sequence number wraps
+	iterations = std::min(iterations, 32767);
+
+	std::cout << "one-way latency of a " << 2 + 8 + 15 * 8 + 120 * 8
+	          << " byte message, " << iterations << " round trips"
+	          << std::endl;
+	std::cout << std::setw(14) << std::left << "transport" << std::right
+	          << std::setw(10) << "median" << std::setw(10) << "p99"
+	          << "  [us]" << std::endl;
+
+	// spinning on a single core waits for the scheduler instead of the writer
+	if (std::thread::hardware_concurrency() > 1)
+	{
+		rtt.clear();
+		errors += run_shm("shm (spin)", 1 << 30, iterations, rtt);
+	}
+	rtt.clear();
+	errors += run_shm("shm (futex)", 0, iterations, rtt);
+	rtt.clear();
+	errors += run_udp("udp loopback", iterations, rtt);
+
+	if (errors > 0) std::cout << errors << " corrupted messages" << std::endl;
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+// Fuzz target for every unpack path of fdcl::serial.
+//
+// With clang, this is built with -fsanitize=fuzzer,address,undefined and run
+// as a libFuzzer binary, e.g., ./fuzz_fdcl_serial -max_total_time=60 corpus/
+//
+// Otherwise FDCL_SERIAL_FUZZ_MAIN is defined, and the binary runs the inputs
+// given as files, or a fixed number of random inputs if no file is given.
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Eigen/Dense"
+#include "Eigen/Sparse"
+
+#include "fdcl/serial.hpp"
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // the first bytes select the unpack calls, the rest is the buffer
+    const size_t num_ops = 8;
+    if (size < num_ops) return 0;
+
+    std::vector<unsigned char> ops(data, data + num_ops);
+    std::vector<unsigned char> received(data + num_ops, data + size);
+
+    fdcl::serial buf;
+    buf.view(received.data(), received.size());
+
+    bool b;
+    int i;
+    float f;
+    double d;
+    Eigen::Matrix<double, 3, 1> v3;
+    Eigen::Matrix<double, 3, 3> M3;
+    Eigen::Matrix<double, 6, 6> M6;
+    Eigen::Matrix<double, 15, 15> M15;
+    Eigen::Matrix<float, 15, 15> F15;
+    Eigen::Matrix<int, 4, 1> i4;
+    Eigen::SparseMatrix<double> S;
+    Eigen::Quaterniond q;
+    Eigen::MatrixXd X;
+    Eigen::VectorXf Xf;
+    std::vector<double> storage;
+
+    for(size_t k = 0; k < num_ops; k++)
+    {
+        switch(ops[k] % 20)
+        {
+            case 0: buf.unpack(b); break;
+            case 1: buf.unpack(i); break;
+            case 2: buf.unpack(f); break;
+            case 3: buf.unpack(d); break;
+            case 4: buf.unpack(v3); break;
+            case 5: buf.unpack(M15); break;
+            case 6: buf.unpack(i4); break;
+            case 7: buf.unpack_as_double(M3); break;
+            case 8: buf.unpack_symmetric(F15); break;
+            case 9: buf.unpack_diagonal(M6); break;
+            case 10: buf.unpack(S); break;
+            case 11: buf.unpack(q); break;
+            case 12: buf.unpack_rotation(M3); break;
+            case 13: buf.unpack_rotation(q); break;
+            case 14: buf.unpack_half(v3); break;
+            case 15: buf.unpack_bfloat16(f); break;
+            case 16: buf.unpack_dynamic(X); break;
+            case 17: buf.unpack_dynamic(storage); break;
+            case 18: buf.unpack_native(Xf); break;
+            case 19: buf.map_native<double>(); break;
+        }
+    }
+
+    return 0;
+}
+
+
+#ifdef FDCL_SERIAL_FUZZ_MAIN
+int main(int argc, char **argv)
+{
+    // silence the unpack error messages, which are expected here
+    std::cout.setstate(std::ios::failbit);
+
+    if (argc > 1)
+    {
+        for(int k = 1; k < argc; k++)
+        {
+            std::ifstream file(argv[k], std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+        return 0;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> input;
+
+    for(int n = 0; n < 200000; n++)
+    {
+        input.resize(rng() % 2048);
+        for(size_t k = 0; k < input.size(); k++) input[k] = rng();
+
+        // small varints, so that sparse matrices get past the size checks
+        if (input.size() > 11 && (n & 1))
+        {
+            for(size_t k = 8; k < 11; k++) input[k] &= 0x3f;
+        }
+
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+
+    return 0;
+}
+#endif
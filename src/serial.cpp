@@ -1,5 +1,23 @@
 #include "fdcl/serial.hpp"
 
+#include <cmath>
+#include <cstring>
+
+// with -mf16c, the F16C instructions are always used, and without it they are
+// used if the CPU supports them. FDCL_SERIAL_NO_F16C forces the software
+// conversion, so that it can be tested on CPUs with F16C.
+#if defined(FDCL_SERIAL_NO_F16C)
+// software conversion only
+#elif defined(__F16C__)
+#define FDCL_SERIAL_F16C_ALWAYS
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FDCL_SERIAL_F16C_DISPATCH
+#endif
+
+#if defined(FDCL_SERIAL_F16C_ALWAYS) || defined(FDCL_SERIAL_F16C_DISPATCH)
+#include <immintrin.h>
+#endif
+
 
 // macros for packing floats and doubles:
 #define pack754_16(f) (pack754((f), 16, 5))
@@ -14,6 +32,10 @@ fdcl::serial::serial()
 {
     // set the initial location of the buffer to be the first index
     loc = 0;
+    ext_buf = NULL;
+    ext_size = 0;
+    ext_capacity = 0;
+    ext_overflow = false;
 };
 
 
@@ -21,6 +43,10 @@ fdcl::serial::serial(unsigned char* buf_received, int size)
 {
     // set the initial location of the buffer to be the first index
     loc = 0;
+    ext_buf = NULL;
+    ext_size = 0;
+    ext_capacity = 0;
+    ext_overflow = false;
 
     buf.insert(buf.end(), buf_received, buf_received + size);
 };
@@ -32,6 +58,10 @@ fdcl::serial::~serial(){};
 void fdcl::serial::clear()
 {
     loc = 0;
+    ext_buf = NULL;
+    ext_size = 0;
+    ext_capacity = 0;
+    ext_overflow = false;
     buf.clear();
 }
 
@@ -39,11 +69,35 @@ void fdcl::serial::clear()
 void fdcl::serial::init(unsigned char* buf_received, int size)
 {
     loc = 0;
+    ext_buf = NULL;
+    ext_size = 0;
+    ext_capacity = 0;
+    ext_overflow = false;
     buf.clear();
     buf.insert(buf.end(), buf_received, buf_received + size);
 };
 
 
+void fdcl::serial::view(unsigned char* buf_received, int size)
+{
+    loc = 0;
+    ext_buf = buf_received;
+    ext_size = size;
+    ext_capacity = size;
+    ext_overflow = false;
+}
+
+
+void fdcl::serial::attach(unsigned char* buf_out, int capacity)
+{
+    loc = 0;
+    ext_buf = buf_out;
+    ext_size = 0;
+    ext_capacity = capacity;
+    ext_overflow = false;
+}
+
+
 void fdcl::serial::reserve(int size)
 {
     buf.reserve(size);
@@ -52,22 +106,60 @@ void fdcl::serial::reserve(int size)
 
 int fdcl::serial::size()
 {
+    if (ext_buf != NULL) return ext_size;
     return buf.size();
 }
 
 
 unsigned char* fdcl::serial::data()
 {
+    return rdata();
+}
+
+
+bool fdcl::serial::overflow()
+{
+    return ext_overflow;
+}
+
+
+unsigned char* fdcl::serial::rdata()
+{
+    // unpacking reads from the viewed or attached memory if there is one
+    if (ext_buf != NULL) return ext_buf;
     return buf.data();
 }
 
 
+void fdcl::serial::append(const unsigned char* data, unsigned int n)
+{
+    if (ext_buf == NULL)
+    {
+        buf.insert(buf.end(), data, data + n);
+        return;
+    }
+
+    if (n > ext_capacity - ext_size)
+    {
+        std::cout << "FDCL SERIAL: serial::pack: buffer overflow" << std::endl;
+
+        // the rest is dropped, as in unpacking, and the message is marked
+        ext_size = ext_capacity;
+        ext_overflow = true;
+        return;
+    }
+
+    memcpy(ext_buf + ext_size, data, n);
+    ext_size += n;
+}
+
+
 void fdcl::serial::pack(int &i)
 {
     unsigned char buf_int[2];
 
     packi16(buf_int, i);
-    buf.insert(buf.end(), buf_int, buf_int + 2);
+    append(buf_int, 2);
 }
 
 
@@ -79,7 +171,7 @@ void fdcl::serial::pack(double &d)
     i = pack754_64(d);  // convert to IEEE 754
     packi64(buf_double, i);
 
-    buf.insert(buf.end(), buf_double, buf_double + 8);
+    append(buf_double, 8);
 }
 
 
@@ -91,7 +183,7 @@ void fdcl::serial::pack(float &f)
     i = pack754_32(f);  // convert to IEEE 754
     packi32(buf_float, i);
 
-    buf.insert(buf.end(), buf_float, buf_float + 4);
+    append(buf_float, 4);
 }
 
 
@@ -108,7 +200,7 @@ void fdcl::serial::pack(bool& b)
         buf_bool[0] = 1;
     }
 
-    buf.insert(buf.end(),buf_bool,buf_bool+1);
+    append(buf_bool, 1);
 }
 
 
@@ -130,7 +222,7 @@ void fdcl::serial::pack(Eigen::MatrixBase<Derived> &M)
             {
                 ii = pack754_64(M(i, j));  // convert to IEEE 754
                 packi64(buf_double, ii);
-                buf.insert(buf.end(), buf_double, buf_double + 8);
+                append(buf_double, 8);
             }
         }
         break;
@@ -142,7 +234,7 @@ void fdcl::serial::pack(Eigen::MatrixBase<Derived> &M)
             {
                 ii = pack754_32(M(i, j));  // convert to IEEE 754
                 packi32(buf_float, ii);
-                buf.insert(buf.end(), buf_float, buf_float + 4);
+                append(buf_float, 4);
             }
         }
         break;
@@ -154,7 +246,7 @@ void fdcl::serial::pack(Eigen::MatrixBase<Derived> &M)
             {
                 ii = pack754_16(M(i, j));  // convert to IEEE 754
                 packi16(buf_int, ii);
-                buf.insert(buf.end(), buf_int, buf_int + 2);
+                append(buf_int, 2);
             }
         }
         break;
@@ -175,7 +267,7 @@ void fdcl::serial::pack_as_float(Eigen::MatrixBase<Derived> &M)
         {
             ii = pack754_32((float) M(i,j));  // convert to IEEE 754
             packi32(buf_float, ii);
-            buf.insert(buf.end(), buf_float, buf_float + 4);
+            append(buf_float, 4);
         }
     }
 }
@@ -186,7 +278,9 @@ void fdcl::serial::unpack(double &d)
     unsigned long long int i;
     unsigned char buf_double[8];
 
-    std::copy(&buf[loc], &buf[loc + 8], buf_double);
+    if (!check_size(8, "serial::unpack(double)")) return;
+
+    std::copy(rdata() + loc, rdata() + loc + 8, buf_double);
     i = unpacku64(buf_double);
     d = unpack754_64(i);
     loc += 8;
@@ -198,7 +292,9 @@ void fdcl::serial::unpack(float &f)
     unsigned long long int i;
     unsigned char buf_float[4];
 
-    std::copy(&buf[loc], &buf[loc + 4], buf_float);
+    if (!check_size(4, "serial::unpack(float)")) return;
+
+    std::copy(rdata() + loc, rdata() + loc + 4, buf_float);
     i = unpacku32(buf_float);
     f = unpack754_32(i);
     loc += 4;
@@ -209,7 +305,9 @@ void fdcl::serial::unpack(int &i)
 {
     unsigned char buf_int[2];
 
-    std::copy(&buf[loc], &buf[loc + 2], buf_int);
+    if (!check_size(2, "serial::unpack(int)")) return;
+
+    std::copy(rdata() + loc, rdata() + loc + 2, buf_int);
     i = unpacki16(buf_int);
     loc += 2;
 }
@@ -217,8 +315,10 @@ void fdcl::serial::unpack(int &i)
 
 void fdcl::serial::unpack(bool &b)
 {
-    if(buf[loc] == 0) b = false;
-    else if (buf[loc] == 1) b = true;
+    if (!check_size(1, "serial::unpack(bool)")) return;
+
+    if(rdata()[loc] == 0) b = false;
+    else if (rdata()[loc] == 1) b = true;
     else std::cout << "FDCL SERIAL: serial::unpack(bool)" << std::endl;
 
     loc += 1;
@@ -236,11 +336,12 @@ void fdcl::serial::unpack(Eigen::MatrixBase<Derived> &M)
     switch(*typeid(type).name())
     {
         case 'd':  // double
+        if (!check_size(M.size() * 8, "serial::unpack(Eigen)")) return;
         for(i = 0; i < M.rows(); i++)
         {
             for(j = 0; j < M.cols(); j++)
             {
-                std::copy(&buf[loc], &buf[loc + 8], buf_double);
+                std::copy(rdata() + loc, rdata() + loc + 8, buf_double);
                 ii = unpacku64(buf_double);
                 M(i, j) = unpack754_64(ii);
                 loc += 8;
@@ -249,11 +350,12 @@ void fdcl::serial::unpack(Eigen::MatrixBase<Derived> &M)
         break;
 
         case 'f':  // float
+        if (!check_size(M.size() * 4, "serial::unpack(Eigen)")) return;
         for(i = 0; i < M.rows(); i++)
         {
             for(j = 0; j < M.cols(); j++)
             {
-                std::copy(&buf[loc], &buf[loc + 4], buf_float);
+                std::copy(rdata() + loc, rdata() + loc + 4, buf_float);
                 ii = unpacku32(buf_float);
                 M(i, j) = unpack754_32(ii);
                 loc += 4;
@@ -262,11 +364,12 @@ void fdcl::serial::unpack(Eigen::MatrixBase<Derived> &M)
         break;
 
         case 'i': // int
+        if (!check_size(M.size() * 2, "serial::unpack(Eigen)")) return;
         for(i = 0; i < M.rows(); i++)
         {
             for(j = 0; j < M.cols(); j++)
             {
-                std::copy(&buf[loc], &buf[loc + 2], buf_int);
+                std::copy(rdata() + loc, rdata() + loc + 2, buf_int);
                 ii = unpacki16(buf_int);
                 M(i, j) = unpack754_16(ii);
                 loc += 2;
@@ -284,11 +387,13 @@ void fdcl::serial::unpack_as_double(Eigen::MatrixBase<Derived>& M)
     unsigned char buf_float[4];
     unsigned long long int ii;
 
+    if (!check_size(M.size() * 4, "serial::unpack_as_double")) return;
+
     for(i = 0; i < M.rows(); i++)
     {
         for(j = 0; j < M.cols(); j++)
         {
-            std::copy(&buf[loc], &buf[loc + 4], buf_float);
+            std::copy(rdata() + loc, rdata() + loc + 4, buf_float);
             ii = unpacku32(buf_float);
             M(i, j) = (double) unpack754_32(ii);
             loc += 4;
@@ -297,6 +402,766 @@ void fdcl::serial::unpack_as_double(Eigen::MatrixBase<Derived>& M)
 }
 
 
+void fdcl::serial::pack_as_half(float &f)
+{
+    unsigned char buf_half[2];
+
+    packi16(buf_half, float_to_half(f));
+    append(buf_half, 2);
+}
+
+
+void fdcl::serial::pack_as_half(double &d)
+{
+    float f = narrow_to_odd(d);
+    pack_as_half(f);
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_as_half(Eigen::MatrixBase<Derived> &M)
+{
+    int i, j;
+    unsigned char buf_half[2];
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            packi16(buf_half, float_to_half(narrow_to_odd(M(i, j))));
+            append(buf_half, 2);
+        }
+    }
+}
+
+
+void fdcl::serial::pack_as_bfloat16(float &f)
+{
+    unsigned char buf_half[2];
+
+    packi16(buf_half, float_to_bfloat16(f));
+    append(buf_half, 2);
+}
+
+
+void fdcl::serial::pack_as_bfloat16(double &d)
+{
+    float f = narrow_to_odd(d);
+    pack_as_bfloat16(f);
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_as_bfloat16(Eigen::MatrixBase<Derived> &M)
+{
+    int i, j;
+    unsigned char buf_half[2];
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            packi16(buf_half, float_to_bfloat16(narrow_to_odd(M(i, j))));
+            append(buf_half, 2);
+        }
+    }
+}
+
+
+void fdcl::serial::unpack_half(float &f)
+{
+    if (!check_size(2, "serial::unpack_half")) return;
+
+    f = half_to_float(unpacku16(rdata() + loc));
+    loc += 2;
+}
+
+
+void fdcl::serial::unpack_half(double &d)
+{
+    float f = 0.0f;
+
+    if (!check_size(2, "serial::unpack_half")) return;
+
+    unpack_half(f);
+    d = f;
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_half(Eigen::MatrixBase<Derived>& M)
+{
+    int i, j;
+
+    if (!check_size(M.size() * 2, "serial::unpack_half")) return;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            M(i, j) = half_to_float(unpacku16(rdata() + loc));
+            loc += 2;
+        }
+    }
+}
+
+
+void fdcl::serial::unpack_bfloat16(float &f)
+{
+    if (!check_size(2, "serial::unpack_bfloat16")) return;
+
+    f = bfloat16_to_float(unpacku16(rdata() + loc));
+    loc += 2;
+}
+
+
+void fdcl::serial::unpack_bfloat16(double &d)
+{
+    float f = 0.0f;
+
+    if (!check_size(2, "serial::unpack_bfloat16")) return;
+
+    unpack_bfloat16(f);
+    d = f;
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_bfloat16(Eigen::MatrixBase<Derived>& M)
+{
+    int i, j;
+
+    if (!check_size(M.size() * 2, "serial::unpack_bfloat16")) return;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            M(i, j) = bfloat16_to_float(unpacku16(rdata() + loc));
+            loc += 2;
+        }
+    }
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_dynamic(Eigen::MatrixBase<Derived> &M)
+{
+    packvarint(M.rows());
+    packvarint(M.cols());
+    pack(M);
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_dynamic(Eigen::PlainObjectBase<Derived>& M)
+{
+    int rows, cols;
+
+    // float and double are packed with their own size
+    typedef typename Eigen::PlainObjectBase<Derived>::Scalar type;
+    if (!unpack_dims(rows, cols, Derived::RowsAtCompileTime,
+        Derived::ColsAtCompileTime, sizeof(type), "serial::unpack_dynamic"))
+    {
+        return;
+    }
+
+    if (M.rows() != rows || M.cols() != cols) M.resize(rows, cols);
+    unpack(M);
+}
+
+
+template<typename Scalar>
+Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+    fdcl::serial::unpack_dynamic(std::vector<Scalar>& storage)
+{
+    typedef Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+        map;
+    int rows, cols;
+
+    if (!unpack_dims(rows, cols, Eigen::Dynamic, Eigen::Dynamic,
+        sizeof(Scalar), "serial::unpack_dynamic"))
+    {
+        return map(NULL, 0, 0);
+    }
+
+    // resize never gives back the capacity
+    storage.resize((size_t) rows * cols);
+
+    map M(storage.data(), rows, cols);
+    unpack(M);
+
+    return M;
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_native(Eigen::PlainObjectBase<Derived> &M)
+{
+    typedef typename Eigen::PlainObjectBase<Derived>::Scalar type;
+    static_assert(!Derived::IsRowMajor || Derived::IsVectorAtCompileTime,
+        "pack_native only supports column major matrices");
+
+    unsigned char buf_tag[1], buf_pad[sizeof(type)] = {0};
+
+    packvarint(M.rows());
+    packvarint(M.cols());
+
+    buf_tag[0] = native_tag(sizeof(type));
+    append(buf_tag, 1);
+
+    // align the values to their size from the beginning of the buffer
+    append(buf_pad, (sizeof(type) - size() % sizeof(type)) % sizeof(type));
+
+    append((const unsigned char*) M.data(), M.size() * sizeof(type));
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_native(Eigen::PlainObjectBase<Derived>& M)
+{
+    typedef typename Eigen::PlainObjectBase<Derived>::Scalar type;
+    static_assert(!Derived::IsRowMajor || Derived::IsVectorAtCompileTime,
+        "unpack_native only supports column major matrices");
+
+    int rows, cols;
+    size_t n;
+
+    if (!unpack_dims(rows, cols, Derived::RowsAtCompileTime,
+        Derived::ColsAtCompileTime, 0, "serial::unpack_native")) return;
+    if (!unpack_native_header(sizeof(type), "serial::unpack_native")) return;
+
+    n = (size_t) rows * cols * sizeof(type);
+    if (!check_size(n, "serial::unpack_native")) return;
+
+    if (M.rows() != rows || M.cols() != cols) M.resize(rows, cols);
+    memcpy(M.data(), rdata() + loc, n);
+    loc += n;
+}
+
+
+template<typename Scalar>
+Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+    fdcl::serial::map_native()
+{
+    typedef Eigen::Map< Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >
+        map;
+    int rows, cols;
+    size_t n;
+    unsigned char *p;
+    unsigned int start = loc;
+
+    if (!unpack_dims(rows, cols, Eigen::Dynamic, Eigen::Dynamic, 0,
+        "serial::map_native")) return map(NULL, 0, 0);
+    if (!unpack_native_header(sizeof(Scalar), "serial::map_native"))
+    {
+        return map(NULL, 0, 0);
+    }
+
+    n = (size_t) rows * cols * sizeof(Scalar);
+    if (!check_size(n, "serial::map_native")) return map(NULL, 0, 0);
+
+    // the received data itself must be aligned, e.g., a vector or shm slot,
+    // otherwise the matrix is left in the buffer for unpack_native
+    p = rdata() + loc;
+    if ((size_t) p % sizeof(Scalar) != 0)
+    {
+        std::cout << "FDCL SERIAL: serial::map_native: unaligned data, use "
+                  << "unpack_native instead" << std::endl;
+        loc = start;
+        return map(NULL, 0, 0);
+    }
+
+    loc += n;
+    return map((Scalar*) p, rows, cols);
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_symmetric(Eigen::MatrixBase<Derived> &M)
+{
+    int i, j;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = i; j < M.cols(); j++)
+        {
+            pack(M(i, j));
+        }
+    }
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_symmetric(Eigen::MatrixBase<Derived>& M)
+{
+    int i, j;
+
+    // float and double are packed with their own size
+    typedef typename Eigen::MatrixBase<Derived>::Scalar type;
+    if (!check_size(M.rows() * (M.rows() + 1) / 2 * sizeof(type),
+        "serial::unpack_symmetric")) return;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = i; j < M.cols(); j++)
+        {
+            unpack(M(i, j));
+            M(j, i) = M(i, j);
+        }
+    }
+}
+
+
+template<typename Derived>
+void fdcl::serial::pack_diagonal(Eigen::MatrixBase<Derived> &M)
+{
+    int i;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        pack(M(i, i));
+    }
+}
+
+
+template<typename Derived>
+void fdcl::serial::unpack_diagonal(Eigen::MatrixBase<Derived>& M)
+{
+    int i;
+
+    typedef typename Eigen::MatrixBase<Derived>::Scalar type;
+    if (!check_size(M.rows() * sizeof(type), "serial::unpack_diagonal")) return;
+
+    M.setZero();
+    for(i = 0; i < M.rows(); i++)
+    {
+        unpack(M(i, i));
+    }
+}
+
+
+void fdcl::serial::pack(Eigen::SparseMatrix<double> &S)
+{
+    // CSR requires row major storage, Eigen defaults to column major
+    Eigen::SparseMatrix<double, Eigen::RowMajor> R(S);
+    R.makeCompressed();
+
+    packvarint(R.rows());
+    packvarint(R.cols());
+    packvarint(R.nonZeros());
+
+    for(int i = 0; i < R.outerSize(); i++)
+    {
+        // number of non-zeros in this row
+        packvarint(R.outerIndexPtr()[i + 1] - R.outerIndexPtr()[i]);
+
+        int j_prev = 0;
+        for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator
+            it(R, i); it; ++it)
+        {
+            packvarint(it.col() - j_prev);  // column indices are increasing
+            j_prev = it.col();
+            pack(it.valueRef());
+        }
+    }
+}
+
+
+void fdcl::serial::unpack(Eigen::SparseMatrix<double> &S)
+{
+    unsigned long long int rows, cols, nnz, nnz_row, count, i, j, k, d;
+    double v;
+    std::vector< Eigen::Triplet<double> > triplets;
+
+    rows = unpackvarint();
+    cols = unpackvarint();
+    nnz = unpackvarint();
+
+    // every row takes at least one byte, and every non-zero at least nine
+    if (rows > (unsigned int) size() - loc
+        || rows > MAX_UNPACK_DIM || cols > MAX_UNPACK_DIM
+        || nnz > ((unsigned int) size() - loc) / 9)
+    {
+        std::cout << "FDCL SERIAL: serial::unpack(SparseMatrix): invalid size"
+                  << std::endl;
+        loc = size();
+        return;
+    }
+    triplets.reserve(nnz);
+
+    count = 0;
+    for(i = 0; i < rows; i++)
+    {
+        nnz_row = unpackvarint();
+        if (nnz_row > nnz - count) break;
+
+        j = 0;
+        for(k = 0; k < nnz_row; k++)
+        {
+            d = unpackvarint();  // delta from the previous column index
+            if (d >= cols - j) break;
+            j += d;
+
+            unpack(v);
+            triplets.push_back(Eigen::Triplet<double>(i, j, v));
+        }
+        if (k < nnz_row) break;
+
+        count += nnz_row;
+    }
+
+    if (i < rows || count != nnz)
+    {
+        std::cout << "FDCL SERIAL: serial::unpack(SparseMatrix): invalid data"
+                  << std::endl;
+        loc = size();
+        return;
+    }
+
+    S.resize(rows, cols);
+    S.setFromTriplets(triplets.begin(), triplets.end());
+}
+
+
+void fdcl::serial::pack(Eigen::Quaterniond &q)
+{
+    pack(q.w());
+    pack(q.x());
+    pack(q.y());
+    pack(q.z());
+}
+
+
+void fdcl::serial::unpack(Eigen::Quaterniond &q)
+{
+    if (!check_size(32, "serial::unpack(Quaterniond)")) return;
+
+    unpack(q.w());
+    unpack(q.x());
+    unpack(q.y());
+    unpack(q.z());
+}
+
+
+void fdcl::serial::pack_rotation(Eigen::Matrix3d &R)
+{
+    pack_rotvec(Eigen::AngleAxisd(R));
+}
+
+
+void fdcl::serial::pack_rotation(Eigen::Quaterniond &q)
+{
+    pack_rotvec(Eigen::AngleAxisd(q));
+}
+
+
+void fdcl::serial::unpack_rotation(Eigen::Matrix3d &R)
+{
+    R = unpack_rotvec().toRotationMatrix();
+}
+
+
+void fdcl::serial::unpack_rotation(Eigen::Quaterniond &q)
+{
+    q = unpack_rotvec();
+}
+
+
+void fdcl::serial::pack_rotvec(const Eigen::AngleAxisd &aa)
+{
+    // angle is in [0, pi], so the rotation vector is well defined
+    Eigen::Matrix<double, 3, 1> r = aa.angle() * aa.axis();
+    pack(r);
+}
+
+
+Eigen::AngleAxisd fdcl::serial::unpack_rotvec()
+{
+    Eigen::Matrix<double, 3, 1> r = Eigen::Matrix<double, 3, 1>::Zero();
+    double angle;
+
+    unpack(r);
+    angle = r.norm();
+
+    if (angle == 0.0) return Eigen::AngleAxisd::Identity();
+    return Eigen::AngleAxisd(angle, r / angle);
+}
+
+
+#ifdef FDCL_SERIAL_F16C_DISPATCH
+namespace
+{
+
+bool has_f16c()
+{
+    static const bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+
+__attribute__((target("f16c"))) unsigned int float_to_half_f16c(float f)
+{
+    return _cvtss_sh(f, 0);
+}
+
+
+__attribute__((target("f16c"))) float half_to_float_f16c(unsigned int h)
+{
+    return _cvtsh_ss(h);
+}
+
+}  // end of anonymous namespace
+#endif
+
+
+unsigned int fdcl::serial::float_to_half(float f)
+{
+#ifdef FDCL_SERIAL_F16C_ALWAYS
+    return _cvtss_sh(f, 0);  // vcvtps2ph, round to nearest even
+#else
+#ifdef FDCL_SERIAL_F16C_DISPATCH
+    if (has_f16c()) return float_to_half_f16c(f);
+#endif
+
+    // software version, bit-for-bit identical to vcvtps2ph
+    uint32_t x, sign, abs, m, h, rem, half;
+    int shift;
+
+    memcpy(&x, &f, 4);
+    sign = (x >> 16) & 0x8000;
+    abs = x & 0x7fffffff;
+
+    // nan keeps the top of its payload, and becomes a quiet nan
+    if (abs > 0x7f800000) return sign | 0x7e00 | ((abs >> 13) & 0x3ff);
+
+    // inf, or large enough to round to inf
+    if (abs >= 0x477ff000) return sign | 0x7c00;
+
+    // normal half, rebias the exponent and round the 13 dropped bits
+    if (abs >= 0x38800000)
+    {
+        abs += 0xc8000fff + ((abs >> 13) & 1);
+        return sign | (abs >> 13);
+    }
+
+    // subnormal half or zero
+    shift = 126 - (int)(abs >> 23);
+    if (shift > 24) return sign;
+
+    m = (abs & 0x7fffff) | 0x800000;
+    h = m >> shift;
+    rem = m & ((1u << shift) - 1);
+    half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) h++;
+
+    return sign | h;
+#endif
+}
+
+
+float fdcl::serial::half_to_float(unsigned int h)
+{
+#ifdef FDCL_SERIAL_F16C_ALWAYS
+    return _cvtsh_ss(h);  // vcvtph2ps
+#else
+#ifdef FDCL_SERIAL_F16C_DISPATCH
+    if (has_f16c()) return half_to_float_f16c(h);
+#endif
+
+    uint32_t x, sign, exp, mant;
+    float f;
+
+    sign = (uint32_t)(h & 0x8000) << 16;
+    exp = (h >> 10) & 0x1f;
+    mant = h & 0x3ff;
+
+    if (exp == 0x1f)
+    {
+        // inf or nan, a signaling nan becomes quiet as with vcvtph2ps
+        x = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+    }
+    else if (exp != 0)
+    {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    else if (mant == 0)
+    {
+        x = sign;
+    }
+    else
+    {
+        // subnormal half is a normal float
+        exp = 113;
+        while(!(mant & 0x400)) { mant <<= 1; exp--; }
+        x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+
+    memcpy(&f, &x, 4);
+    return f;
+#endif
+}
+
+
+float fdcl::serial::narrow_to_odd(double d)
+{
+    // rounding a double to a float and then to 16 bits rounds twice, e.g.,
+    // 1 + 2^-11 + 2^-40 becomes the tie 1 + 2^-11 and then 1 as a half.
+    // Truncating to a float and setting its last bit if anything was dropped
+    // keeps the dropped bits visible to the final rounding, as a float has
+    // more than two bits beyond the 11 or 8 bits of a half or bfloat16.
+    float f = (float) d;
+    uint32_t x;
+
+    if (std::isnan(d) || (double) f == d) return f;
+
+    memcpy(&x, &f, 4);
+    if (std::fabs((double) f) > std::fabs(d)) x--;  // toward zero, inf too
+    x |= 1;
+    memcpy(&f, &x, 4);
+
+    return f;
+}
+
+
+float fdcl::serial::narrow_to_odd(float f)
+{
+    return f;
+}
+
+
+unsigned int fdcl::serial::float_to_bfloat16(float f)
+{
+    // a bfloat16 is the upper half of a float, so rounding is done in
+    // integers, which is as fast as the AVX512-BF16 instructions and does not
+    // flush subnormals to zero like them
+    uint32_t x;
+
+    memcpy(&x, &f, 4);
+
+    if ((x & 0x7fffffff) > 0x7f800000) return (x >> 16) | 0x40;  // quiet nan
+
+    x += 0x7fff + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+
+float fdcl::serial::bfloat16_to_float(unsigned int h)
+{
+    uint32_t x = (uint32_t)(h & 0xffff) << 16;
+    float f;
+
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+
+void fdcl::serial::packvarint(unsigned long long int i)
+{
+    // 7 bits per byte, least significant group first, MSB set if more follow
+    unsigned char buf_varint[10];
+    int n = 0;
+
+    while(i >= 0x80)
+    {
+        buf_varint[n++] = (unsigned char)(i | 0x80);
+        i >>= 7;
+    }
+    buf_varint[n++] = (unsigned char) i;
+
+    append(buf_varint, n);
+}
+
+
+unsigned long long int fdcl::serial::unpackvarint()
+{
+    unsigned long long int i = 0;
+    unsigned shift = 0;
+
+    while(shift < 64)
+    {
+        if (!check_size(1, "serial::unpackvarint")) return 0;
+
+        unsigned char b = rdata()[loc++];
+        i |= (unsigned long long int)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+
+    return i;
+}
+
+
+bool fdcl::serial::unpack_dims(int &rows, int &cols, int rows_fixed,
+    int cols_fixed, unsigned int elem_size, const char* fn)
+{
+    unsigned long long int r, c;
+
+    r = unpackvarint();
+    c = unpackvarint();
+
+    if (r > MAX_UNPACK_DIM || c > MAX_UNPACK_DIM
+        || (rows_fixed != Eigen::Dynamic && r != (unsigned int) rows_fixed)
+        || (cols_fixed != Eigen::Dynamic && c != (unsigned int) cols_fixed))
+    {
+        std::cout << "FDCL SERIAL: " << fn << ": invalid size" << std::endl;
+        loc = size();
+        return false;
+    }
+
+    if (!check_size(r * c * elem_size, fn)) return false;
+
+    rows = r;
+    cols = c;
+    return true;
+}
+
+
+unsigned char fdcl::serial::native_tag(unsigned int elem_size)
+{
+    // scalar size, and the top bit for big endian
+    unsigned short int one = 1;
+    return elem_size | (*(unsigned char*) &one == 1 ? 0 : 0x80);
+}
+
+
+bool fdcl::serial::unpack_native_header(unsigned int elem_size,
+    const char* fn)
+{
+    unsigned int n;
+
+    if (!check_size(1, fn)) return false;
+    if (rdata()[loc] != native_tag(elem_size))
+    {
+        std::cout << "FDCL SERIAL: " << fn << ": packed on a host with a "
+                  << "different byte order or scalar type" << std::endl;
+        loc = size();
+        return false;
+    }
+    loc += 1;
+
+    // skip the padding
+    n = (elem_size - loc % elem_size) % elem_size;
+    if (!check_size(n, fn)) return false;
+    loc += n;
+
+    return true;
+}
+
+
+bool fdcl::serial::check_size(unsigned long long int n, const char* fn)
+{
+    // make sure that the next n bytes are within the received data
+    if (n <= (unsigned int) size() - loc) return true;
+
+    std::cout << "FDCL SERIAL: " << fn << ": buffer overrun" << std::endl;
+
+    // the rest of the buffer can not be trusted after a mismatch
+    loc = size();
+    return false;
+}
+
+
 unsigned long long int fdcl::serial::pack754(long double f, unsigned bits,
     unsigned expbits)
 {
@@ -468,6 +1333,8 @@ template void fdcl::serial::pack(
         Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
 template void fdcl::serial::pack(
         Eigen::MatrixBase< Eigen::Matrix<double,8,1> >& M);
+template void fdcl::serial::pack(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,1> >& M);
 template void fdcl::serial::pack(
         Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
 
@@ -530,6 +1397,8 @@ template void fdcl::serial::unpack(
         Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
 template void fdcl::serial::unpack(
         Eigen::MatrixBase< Eigen::Matrix<double,8,1> >& M);
+template void fdcl::serial::unpack(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,1> >& M);
 template void fdcl::serial::unpack(
         Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
 template void fdcl::serial::unpack(
@@ -537,4 +1406,129 @@ template void fdcl::serial::unpack(
 template void fdcl::serial::unpack(
         Eigen::MatrixBase< Eigen::Matrix<int,6,1> >& M);
 template void fdcl::serial::unpack(
-        Eigen::MatrixBase< Eigen::Matrix<int,8,1> >& M);
\ No newline at end of file
+        Eigen::MatrixBase< Eigen::Matrix<int,8,1> >& M);
+
+
+template void fdcl::serial::pack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,3> >& M);
+template void fdcl::serial::pack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,6> >& M);
+template void fdcl::serial::pack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
+template void fdcl::serial::pack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<float,15,15> >& M);
+
+template void fdcl::serial::unpack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,3> >& M);
+template void fdcl::serial::unpack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,6> >& M);
+template void fdcl::serial::unpack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
+template void fdcl::serial::unpack_symmetric(
+        Eigen::MatrixBase< Eigen::Matrix<float,15,15> >& M);
+
+template void fdcl::serial::pack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,3> >& M);
+template void fdcl::serial::pack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,6> >& M);
+template void fdcl::serial::pack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
+
+template void fdcl::serial::unpack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,3> >& M);
+template void fdcl::serial::unpack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,6> >& M);
+template void fdcl::serial::unpack_diagonal(
+        Eigen::MatrixBase< Eigen::Matrix<double,15,15> >& M);
+
+
+template void fdcl::serial::pack_as_half(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,1> >& M);
+template void fdcl::serial::pack_as_half(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
+template void fdcl::serial::pack_as_half(
+        Eigen::MatrixBase< Eigen::Matrix<float,3,1> >& M);
+template void fdcl::serial::pack_as_half(
+        Eigen::MatrixBase< Eigen::Matrix<float,6,1> >& M);
+
+template void fdcl::serial::pack_as_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,1> >& M);
+template void fdcl::serial::pack_as_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
+template void fdcl::serial::pack_as_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<float,3,1> >& M);
+template void fdcl::serial::pack_as_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<float,6,1> >& M);
+
+template void fdcl::serial::unpack_half(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,1> >& M);
+template void fdcl::serial::unpack_half(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
+template void fdcl::serial::unpack_half(
+        Eigen::MatrixBase< Eigen::Matrix<float,3,1> >& M);
+template void fdcl::serial::unpack_half(
+        Eigen::MatrixBase< Eigen::Matrix<float,6,1> >& M);
+
+template void fdcl::serial::unpack_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,1> >& M);
+template void fdcl::serial::unpack_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<double,6,1> >& M);
+template void fdcl::serial::unpack_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<float,3,1> >& M);
+template void fdcl::serial::unpack_bfloat16(
+        Eigen::MatrixBase< Eigen::Matrix<float,6,1> >& M);
+
+
+template void fdcl::serial::pack_dynamic(
+        Eigen::MatrixBase< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_dynamic(
+        Eigen::MatrixBase< Eigen::Matrix<double,Eigen::Dynamic,1> >& M);
+template void fdcl::serial::pack_dynamic(
+        Eigen::MatrixBase< Eigen::Matrix<double,3,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_dynamic(
+        Eigen::MatrixBase< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_dynamic(
+        Eigen::MatrixBase< Eigen::Matrix<float,Eigen::Dynamic,1> >& M);
+
+template void fdcl::serial::unpack_dynamic(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_dynamic(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,1> >& M);
+template void fdcl::serial::unpack_dynamic(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,3,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_dynamic(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_dynamic(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,1> >& M);
+
+template Eigen::Map< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >
+    fdcl::serial::unpack_dynamic(std::vector<double>& storage);
+template Eigen::Map< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >
+    fdcl::serial::unpack_dynamic(std::vector<float>& storage);
+
+template void fdcl::serial::pack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,1> >& M);
+template void fdcl::serial::pack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,3,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::pack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,1> >& M);
+
+template void fdcl::serial::unpack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,Eigen::Dynamic,1> >& M);
+template void fdcl::serial::unpack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<double,3,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >& M);
+template void fdcl::serial::unpack_native(
+        Eigen::PlainObjectBase< Eigen::Matrix<float,Eigen::Dynamic,1> >& M);
+
+template Eigen::Map< Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> >
+    fdcl::serial::map_native<double>();
+template Eigen::Map< Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic> >
+    fdcl::serial::map_native<float>();
@@ -0,0 +1,380 @@
+#include "fdcl/serial_receiver.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdint.h>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+
+fdcl::serial_receiver::serial_receiver()
+{
+    fd = -1;
+    running = false;
+    num_slots = 0;
+    slot_size = 0;
+    batch = 0;
+};
+
+
+fdcl::serial_receiver::~serial_receiver()
+{
+    close();
+};
+
+
+bool fdcl::serial_receiver::open(int port, int num_workers, handler h,
+    int num_slots, int slot_size, int batch, int rcvbuf)
+{
+    int i, on = 1;
+    sockaddr_in addr;
+    timeval timeout;
+
+    if (fd >= 0) close();
+    if (num_workers < 1) num_workers = 1;
+
+    if (num_slots < 1 || slot_size < 1 || batch < 1)
+    {
+        std::cout << "FDCL SERIAL: serial_receiver::open: num_slots, "
+                  << "slot_size and batch must be positive" << std::endl;
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        std::cout << "FDCL SERIAL: serial_receiver::open: socket: "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    // report the number of datagrams dropped by the kernel with each datagram
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+
+    // wake up periodically so that close() does not wait for a datagram
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (rcvbuf > 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+    {
+        std::cout << "FDCL SERIAL: serial_receiver::open: bind: "
+                  << strerror(errno) << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    this->h = h;
+    this->num_slots = num_slots;
+    this->slot_size = slot_size;
+    this->batch = std::min(batch, num_slots);
+
+    // all slots are allocated once, and reused for every datagram
+    slab.assign((size_t) num_slots * slot_size, 0);
+    slot_len.assign(num_slots, 0);
+    slot_from.resize(num_slots);
+
+    free_slots.clear();
+    free_slots.reserve(num_slots);
+    for(i = num_slots - 1; i >= 0; i--) free_slots.push_back(i);
+
+    received = 0;
+    batches = 0;
+    truncated = 0;
+    dropped = 0;
+    in_flight = 0;
+    in_flight_max = 0;
+
+    running = true;
+
+    workers.clear();
+    for(i = 0; i < num_workers; i++)
+    {
+        workers.push_back(std::unique_ptr<worker>(new worker));
+        worker &w = *workers.back();
+        w.queue.reserve(num_slots);
+        w.depth = 0;
+        w.depth_max = 0;
+        w.processed = 0;
+    }
+    for(i = 0; i < num_workers; i++)
+    {
+        worker &w = *workers[i];
+        w.thread = std::thread(&fdcl::serial_receiver::work_loop, this,
+            std::ref(w));
+    }
+
+    receiver = std::thread(&fdcl::serial_receiver::receive_loop, this);
+
+    return true;
+}
+
+
+void fdcl::serial_receiver::close()
+{
+    if (fd < 0) return;
+
+    running = false;
+
+    free_cv.notify_all();
+    if (receiver.joinable()) receiver.join();
+
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers[i]->mtx);
+        }
+        workers[i]->cv.notify_all();
+        if (workers[i]->thread.joinable()) workers[i]->thread.join();
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+
+int fdcl::serial_receiver::port()
+{
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (fd < 0) return -1;
+    if (getsockname(fd, (sockaddr*) &addr, &len) < 0) return -1;
+
+    return ntohs(addr.sin_port);
+}
+
+
+fdcl::serial_receiver::stats fdcl::serial_receiver::get_stats()
+{
+    stats s;
+
+    s.received = received;
+    s.batches = batches;
+    s.truncated = truncated;
+    s.dropped = dropped;
+    s.slots_in_flight = in_flight;
+    s.slots_in_flight_max = in_flight_max;
+
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        s.queue_depth.push_back(workers[i]->depth);
+        s.queue_depth_max.push_back(workers[i]->depth_max);
+        s.processed.push_back(workers[i]->processed);
+    }
+
+    return s;
+}
+
+
+void fdcl::serial_receiver::receive_loop()
+{
+    int i, k, n, r, idx;
+    const size_t control_size = CMSG_SPACE(sizeof(uint32_t));
+
+    std::vector<mmsghdr> msgs(batch);
+    std::vector<iovec> iovs(batch);
+    std::vector<unsigned char> control(batch * control_size);
+
+    std::vector<int> pool;  // slots taken from the free list
+    std::vector<int> keep;  // slots not used by the last recvmmsg call
+    std::vector< std::vector<int> > staged(workers.size());
+
+    pool.reserve(num_slots);
+    keep.reserve(batch);
+    for(i = 0; i < (int) staged.size(); i++) staged[i].reserve(batch);
+
+    while(running)
+    {
+        // refill the pool, and only block if there is no slot left
+        if ((int) pool.size() < batch)
+        {
+            std::unique_lock<std::mutex> lock(free_mtx);
+            if (pool.empty())
+            {
+                free_cv.wait_for(lock, std::chrono::milliseconds(100),
+                    [this]{ return !free_slots.empty() || !running; });
+            }
+            while((int) pool.size() < batch && !free_slots.empty())
+            {
+                pool.push_back(free_slots.back());
+                free_slots.pop_back();
+            }
+        }
+        if (pool.empty()) continue;
+
+        n = std::min(batch, (int) pool.size());
+        for(k = 0; k < n; k++)
+        {
+            idx = pool[pool.size() - n + k];
+
+            iovs[k].iov_base = &slab[(size_t) idx * slot_size];
+            iovs[k].iov_len = slot_size;
+
+            memset(&msgs[k].msg_hdr, 0, sizeof(msghdr));
+            msgs[k].msg_hdr.msg_name = &slot_from[idx];
+            msgs[k].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[k].msg_hdr.msg_iov = &iovs[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+            msgs[k].msg_hdr.msg_control = &control[k * control_size];
+            msgs[k].msg_hdr.msg_controllen = control_size;
+        }
+
+        // block for the first datagram, then take whatever else is queued
+        r = recvmmsg(fd, msgs.data(), n, MSG_WAITFORONE, NULL);
+        if (r <= 0)
+        {
+            if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+                && errno != EINTR)
+            {
+                std::cout << "FDCL SERIAL: serial_receiver: recvmmsg: "
+                          << strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        keep.clear();
+        for(k = 0; k < n; k++)
+        {
+            idx = pool[pool.size() - n + k];
+
+            if (k >= r)
+            {
+                keep.push_back(idx);
+                continue;
+            }
+
+            msghdr &hdr = msgs[k].msg_hdr;
+            for(cmsghdr *c = CMSG_FIRSTHDR(&hdr); c != NULL;
+                c = CMSG_NXTHDR(&hdr, c))
+            {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+                {
+                    uint32_t count;
+                    memcpy(&count, CMSG_DATA(c), sizeof(count));
+                    dropped = count;  // cumulative for the socket
+                }
+            }
+
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                truncated++;
+                keep.push_back(idx);
+                continue;
+            }
+
+            slot_len[idx] = msgs[k].msg_len;
+            staged[worker_of(slot_from[idx], workers.size())].push_back(idx);
+        }
+        pool.resize(pool.size() - n);
+        pool.insert(pool.end(), keep.begin(), keep.end());
+
+        received += r;
+        batches++;
+        update_max(in_flight_max, in_flight += n - keep.size());
+
+        // hand over the datagrams, locking each worker queue once per batch
+        for(i = 0; i < (int) staged.size(); i++)
+        {
+            if (staged[i].empty()) continue;
+
+            worker &w = *workers[i];
+            {
+                // the depth is set under the lock, so that it is not
+                // overwritten after the worker has emptied the queue
+                std::lock_guard<std::mutex> lock(w.mtx);
+                w.queue.insert(w.queue.end(), staged[i].begin(),
+                    staged[i].end());
+                w.depth = w.queue.size();
+                update_max(w.depth_max, w.depth);
+            }
+            w.cv.notify_one();
+
+            staged[i].clear();
+        }
+    }
+}
+
+
+void fdcl::serial_receiver::work_loop(worker &w)
+{
+    std::vector<int> local;
+    fdcl::serial buf;
+    size_t i;
+    int idx;
+
+    local.reserve(num_slots);
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(w.mtx);
+            w.cv.wait(lock, [&]{ return !w.queue.empty() || !running; });
+            if (w.queue.empty()) break;  // only when stopped and drained
+            local.swap(w.queue);
+            w.depth = 0;
+        }
+
+        for(i = 0; i < local.size(); i++)
+        {
+            idx = local[i];
+            buf.view(&slab[(size_t) idx * slot_size], slot_len[idx]);
+            h(slot_from[idx], buf);
+        }
+        w.processed += local.size();
+
+        // return the slots in one go
+        {
+            std::lock_guard<std::mutex> lock(free_mtx);
+            free_slots.insert(free_slots.end(), local.begin(), local.end());
+        }
+        free_cv.notify_one();
+
+        in_flight -= local.size();
+        local.clear();
+    }
+}
+
+
+int fdcl::serial_receiver::worker_of(const sockaddr_in &from,
+    int num_workers)
+{
+    // the same source is always mapped to the same worker to keep its order
+    uint32_t key = ntohl(from.sin_addr.s_addr)
+        ^ (uint32_t) ntohs(from.sin_port) * 0x9e3779b1u;
+
+    // murmur3 fmix32, so that every bit of the address and the port affects
+    // the low bits used by the modulo
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+
+    return key % (uint32_t) num_workers;
+}
+
+
+void fdcl::serial_receiver::update_max(std::atomic<unsigned int> &max,
+    unsigned int v)
+{
+    unsigned int prev = max;
+    while(prev < v && !max.compare_exchange_weak(prev, v)) {}
+}
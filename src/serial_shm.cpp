@@ -0,0 +1,323 @@
+#include "fdcl/serial_shm.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define SERIAL_SHM_MAGIC 0x4644434cu  // "FDCL"
+#define SERIAL_SHM_ALIGN 64  // header, slot headers and data are aligned to it
+#define SERIAL_SHM_DROPPED 0xffffffffu  // size of a message that did not fit
+
+
+namespace
+{
+
+long futex(std::atomic<uint32_t> *addr, int op, uint32_t val,
+    const timespec *timeout)
+{
+    // not FUTEX_PRIVATE_FLAG, as the word is shared between processes
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val,
+        timeout, NULL, 0);
+}
+
+
+void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+}  // end of anonymous namespace
+
+
+fdcl::serial_shm::serial_shm()
+{
+    // spinning only helps if the writer runs on another core
+    spin = std::thread::hardware_concurrency() > 1 ? 200 : 0;
+    fd = -1;
+    mem = NULL;
+    mem_size = 0;
+    hdr = NULL;
+    stride = 0;
+    claimed = 0;
+    next = 0;
+    num_lost = 0;
+};
+
+
+fdcl::serial_shm::~serial_shm()
+{
+    close();
+};
+
+
+bool fdcl::serial_shm::open(const std::string &name, int num_slots,
+    int slot_size)
+{
+    bool creator;
+    struct stat st;
+    int k;
+
+    static_assert(sizeof(header) <= SERIAL_SHM_ALIGN, "header too large");
+    static_assert(sizeof(slot) <= SERIAL_SHM_ALIGN, "slot header too large");
+
+    if (mem != NULL) close();
+
+    stride = SERIAL_SHM_ALIGN
+        + (slot_size + SERIAL_SHM_ALIGN - 1) / SERIAL_SHM_ALIGN
+        * SERIAL_SHM_ALIGN;
+    mem_size = SERIAL_SHM_ALIGN + num_slots * stride;
+
+    // only one process creates and initializes the ring
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    creator = fd >= 0;
+    if (!creator && errno == EEXIST) fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        std::cout << "FDCL SERIAL: serial_shm::open: shm_open: "
+                  << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (creator)
+    {
+        if (ftruncate(fd, mem_size) < 0)
+        {
+            std::cout << "FDCL SERIAL: serial_shm::open: ftruncate: "
+                      << strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+    }
+    else
+    {
+        // wait for the creator to size it
+        st.st_size = 0;
+        for(k = 0; k < 1000; k++)
+        {
+            if (fstat(fd, &st) == 0 && st.st_size > 0) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (st.st_size != (off_t) mem_size)
+        {
+            std::cout << "FDCL SERIAL: serial_shm::open: " << name
+                      << " has a different number or size of slots"
+                      << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    mem = (unsigned char*) mmap(NULL, mem_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        std::cout << "FDCL SERIAL: serial_shm::open: mmap: "
+                  << strerror(errno) << std::endl;
+        mem = NULL;
+        close();
+        return false;
+    }
+    hdr = (header*) mem;
+
+    if (creator)
+    {
+        // the memory is zero filled, so all sequence numbers start at zero
+        hdr->num_slots = num_slots;
+        hdr->slot_size = slot_size;
+        __atomic_store_n(&hdr->magic, SERIAL_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        for(k = 0; k < 1000; k++)
+        {
+            if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE)
+                == SERIAL_SHM_MAGIC) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (hdr->magic != SERIAL_SHM_MAGIC
+            || hdr->num_slots != (uint32_t) num_slots
+            || hdr->slot_size != (uint32_t) slot_size)
+        {
+            std::cout << "FDCL SERIAL: serial_shm::open: " << name
+                      << " has a different number or size of slots"
+                      << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    next = hdr->head.load();
+    num_lost = 0;
+
+    return true;
+}
+
+
+void fdcl::serial_shm::close()
+{
+    if (mem != NULL) munmap(mem, mem_size);
+    if (fd >= 0) ::close(fd);
+
+    mem = NULL;
+    hdr = NULL;
+    fd = -1;
+}
+
+
+void fdcl::serial_shm::unlink(const std::string &name)
+{
+    shm_unlink(name.c_str());
+}
+
+
+void fdcl::serial_shm::claim(fdcl::serial &buf)
+{
+    claimed = hdr->head.fetch_add(1);
+
+    // mark the slot as being written before touching its data
+    slot_at(claimed)->seq.store(2 * claimed + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    buf.attach(data_at(claimed), hdr->slot_size);
+}
+
+
+bool fdcl::serial_shm::publish(fdcl::serial &buf)
+{
+    slot *s = slot_at(claimed);
+    bool valid = !buf.overflow();
+
+    // an incomplete message still completes the slot, so that readers do not
+    // wait on it, but they skip it
+    s->size = valid ? buf.size() : SERIAL_SHM_DROPPED;
+    s->seq.store(2 * claimed + 2, std::memory_order_release);
+    buf.clear();
+
+    // readers take a snapshot of the futex word before checking the slot,
+    // so a reader that goes to sleep after this is woken up right away
+    hdr->futex.fetch_add(1);
+    if (hdr->waiters.load() > 0)
+    {
+        futex(&hdr->futex, FUTEX_WAKE, INT_MAX, NULL);
+    }
+
+    if (!valid)
+    {
+        std::cout << "FDCL SERIAL: serial_shm::publish: message larger than "
+                  << "the slot size is dropped" << std::endl;
+    }
+    return valid;
+}
+
+
+bool fdcl::serial_shm::read(fdcl::serial &buf, int timeout_ms)
+{
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(timeout_ms);
+    timespec ts;
+    uint64_t seq, head, oldest;
+    uint32_t f;
+    int polls = 0;
+
+    while(true)
+    {
+        f = hdr->futex.load();
+
+        slot *s = slot_at(next);
+        seq = s->seq.load(std::memory_order_acquire);
+
+        if (seq == 2 * next + 2 && s->size == SERIAL_SHM_DROPPED)
+        {
+            num_lost++;
+            next++;
+            continue;
+        }
+
+        if (seq == 2 * next + 2)
+        {
+            buf.view(data_at(next), std::min(s->size, hdr->slot_size));
+            return true;
+        }
+
+        if (seq > 2 * next + 2)
+        {
+            // the writer lapped this reader, skip to the oldest message
+            head = hdr->head.load();
+            oldest = head - hdr->num_slots;
+            num_lost += oldest - next;
+            next = oldest;
+            continue;
+        }
+
+        if (polls < spin)
+        {
+            polls++;
+            cpu_relax();
+            continue;
+        }
+
+        if (timeout_ms < 0)
+        {
+            hdr->waiters.fetch_add(1);
+            futex(&hdr->futex, FUTEX_WAIT, f, NULL);
+            hdr->waiters.fetch_sub(1);
+            continue;
+        }
+
+        std::chrono::nanoseconds remaining =
+            deadline - std::chrono::steady_clock::now();
+        if (remaining.count() <= 0) return false;
+
+        ts.tv_sec = remaining.count() / 1000000000;
+        ts.tv_nsec = remaining.count() % 1000000000;
+
+        hdr->waiters.fetch_add(1);
+        futex(&hdr->futex, FUTEX_WAIT, f, &ts);
+        hdr->waiters.fetch_sub(1);
+    }
+}
+
+
+bool fdcl::serial_shm::release()
+{
+    // the unpacked values are only valid if the slot was not reused meanwhile
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool valid = slot_at(next)->seq.load(std::memory_order_relaxed)
+        == 2 * next + 2;
+
+    next++;
+    return valid;
+}
+
+
+unsigned long long int fdcl::serial_shm::lost()
+{
+    return num_lost;
+}
+
+
+fdcl::serial_shm::slot *fdcl::serial_shm::slot_at(uint64_t n)
+{
+    return (slot*)(mem + SERIAL_SHM_ALIGN + (n % hdr->num_slots) * stride);
+}
+
+
+unsigned char *fdcl::serial_shm::data_at(uint64_t n)
+{
+    return (unsigned char*) slot_at(n) + SERIAL_SHM_ALIGN;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <iomanip> // for setprecision
 #include "Eigen/Dense"
+#include "Eigen/Sparse"
 
 #include "fdcl/serial.hpp"
 
@@ -65,4 +66,34 @@ int main(void)
 
 	buf_recv.unpack(vec);
     std::cout << "vec = " << vec << std::endl;
+
+	// structured matrices
+	Eigen::Matrix<double, 15, 15> P, P_recv;
+	Eigen::Quaterniond q(Eigen::AngleAxisd(0.5, Eigen::Vector3d::UnitZ())),
+		q_recv;
+	Eigen::SparseMatrix<double> S(100, 100), S_recv;
+
+	P.setRandom();
+	P = (P + P.transpose()).eval();
+	S.insert(3, 7) = 1.5;
+	S.insert(42, 0) = -2.0;
+	S.insert(99, 99) = 0.25;
+
+	buf_send.clear();
+	buf_send.pack_symmetric(P); // 8x15x16/2 = 960 bytes
+	buf_send.pack_rotation(q);  // 8x3 = 24 bytes
+	buf_send.pack(S);           // 3 + 100 + 3x(1 + 8) = 130 bytes
+
+    std::cout << "buf_send_size = " << buf_send.size() << " bytes" 
+              << std::endl;
+
+	buf_recv.init(buf_send.data(), buf_send.size());
+	buf_recv.unpack_symmetric(P_recv);
+	buf_recv.unpack_rotation(q_recv);
+	buf_recv.unpack(S_recv);
+
+    std::cout << "|P - P_recv| = " << (P - P_recv).norm() << std::endl;
+    std::cout << "|q - q_recv| = " << (q.coeffs() - q_recv.coeffs()).norm()
+              << std::endl;
+    std::cout << "|S - S_recv| = " << (S - S_recv).norm() << std::endl;
 }
@@ -0,0 +1,963 @@
+// Differential test of fdcl::serial against a frozen reference of the wire
+// format.
+//
+// The reference below is a copy of the original Beej based implementation,
+// and must not be changed when fdcl::serial is optimized. Randomized values
+// and shapes are packed by both, and the bytes must match bit-for-bit.
+// Randomized buffers are unpacked by both, and the values must match
+// bit-for-bit.
+//
+// Usage: test_fdcl_serial_diff [iterations] [seed]
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAS_X86_TARGET
+#endif
+
+#include "Eigen/Dense"
+#include "Eigen/Sparse"
+
+#include "fdcl/serial.hpp"
+
+
+namespace ref
+{
+
+typedef std::vector<unsigned char> bytes;
+
+
+unsigned long long int pack754(long double f, unsigned bits, unsigned expbits)
+{
+    long double fnorm;
+    int shift;
+    long long sign, exp, significand;
+    unsigned significandbits = bits - expbits - 1;
+
+    if (f == 0.0) return 0;
+
+    if (f < 0) { sign = 1; fnorm = -f; }
+    else { sign = 0; fnorm = f; }
+
+    shift = 0;
+    while(fnorm >= 2.0) { fnorm /= 2.0; shift++; }
+    while(fnorm < 1.0) { fnorm *= 2.0; shift--; }
+    fnorm = fnorm - 1.0;
+
+    significand = fnorm * ((1LL<<significandbits) + 0.5f);
+
+    exp = shift + ((1<<(expbits-1)) - 1);
+
+    return (sign<<(bits-1)) | (exp<<(bits-expbits-1)) | significand;
+}
+
+
+long double unpack754(unsigned long long int i, unsigned bits,
+    unsigned expbits)
+{
+    long double result;
+    long long shift;
+    unsigned bias;
+    unsigned significandbits = bits - expbits - 1;
+
+    if (i == 0) return 0.0;
+
+    result = (i&((1LL<<significandbits)-1));
+    result /= (1LL<<significandbits);
+    result += 1.0f;
+
+    bias = (1<<(expbits-1)) - 1;
+    shift = ((i>>significandbits)&((1LL<<expbits)-1)) - bias;
+    while(shift > 0) { result *= 2.0; shift--; }
+    while(shift < 0) { result /= 2.0; shift++; }
+
+    result *= (i>>(bits-1))&1? -1.0: 1.0;
+
+    return result;
+}
+
+
+// big endian, n bytes
+void put(bytes &b, unsigned long long int i, int n)
+{
+    for(int k = n - 1; k >= 0; k--) b.push_back((unsigned char)(i >> (8 * k)));
+}
+
+
+unsigned long long int get(const unsigned char *b, int n)
+{
+    unsigned long long int i = 0;
+    for(int k = 0; k < n; k++) i = (i << 8) | b[k];
+    return i;
+}
+
+
+int get_i16(const unsigned char *b)
+{
+    unsigned int i2 = get(b, 2);
+    return i2 <= 0x7fffu ? (int) i2 : -1 - (int)(0xffffu - i2);
+}
+
+
+void put_varint(bytes &b, unsigned long long int i)
+{
+    while(i >= 0x80) { b.push_back((unsigned char)(i | 0x80)); i >>= 7; }
+    b.push_back((unsigned char) i);
+}
+
+
+void put(bytes &b, bool v) { b.push_back(v ? 1 : 0); }
+void put(bytes &b, int v) { put(b, (unsigned int) v, 2); }
+void put(bytes &b, float v) { put(b, pack754(v, 32, 8), 4); }
+void put(bytes &b, double v) { put(b, pack754(v, 64, 11), 8); }
+
+// Eigen int matrices are packed as 16 bit floats
+void put_matrix(bytes &b, int v) { put(b, pack754(v, 16, 5), 2); }
+void put_matrix(bytes &b, float v) { put(b, v); }
+void put_matrix(bytes &b, double v) { put(b, v); }
+
+void get(const unsigned char *b, float &v) { v = unpack754(get(b, 4), 32, 8); }
+void get(const unsigned char *b, double &v)
+{
+    v = unpack754(get(b, 8), 64, 11);
+}
+
+void get_matrix(const unsigned char *b, int &v)
+{
+    v = unpack754(get_i16(b), 16, 5);
+}
+void get_matrix(const unsigned char *b, float &v) { get(b, v); }
+void get_matrix(const unsigned char *b, double &v) { get(b, v); }
+
+// Half precision and bfloat16 are new, so the reference is written
+// independently of the library: the rounding is done in double arithmetic,
+// straight from the float or double given, and nan follows the F16C
+// instructions.
+unsigned int half(double d)
+{
+    float f = (float) d;
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    unsigned int sign = (x >> 16) & 0x8000;
+
+    if (std::isnan(f)) return sign | 0x7e00 | ((x >> 13) & 0x3ff);
+
+    double a = std::fabs(d);
+    if (a >= 65520.0) return sign | 0x7c00;
+    if (a < std::ldexp(1.0, -14))
+    {
+        return sign | (unsigned int) std::nearbyint(std::ldexp(a, 24));
+    }
+
+    int e;
+    std::frexp(a, &e);
+    e--;
+    unsigned int m = std::nearbyint((std::ldexp(a, -e) - 1.0) * 1024.0);
+    if (m == 1024) { m = 0; e++; }
+
+    return sign | ((e + 15) << 10) | m;
+}
+
+
+float from_half(unsigned int h)
+{
+    unsigned int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+    float f;
+
+    if (e == 31)
+    {
+        uint32_t x = ((uint32_t)(h & 0x8000) << 16) | 0x7f800000 | (m << 13)
+            | (m ? 0x400000 : 0);
+        std::memcpy(&f, &x, 4);
+        return f;
+    }
+
+    if (e == 0) f = std::ldexp((double) m, -24);
+    else f = std::ldexp((double)(1024 + m), (int) e - 25);
+
+    return (h & 0x8000) ? -f : f;
+}
+
+
+unsigned int bfloat16(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+
+    if (std::isnan(f)) return (x >> 16) | 0x40;
+
+    uint32_t upper = x >> 16, lower = x & 0xffff;
+    if (lower > 0x8000 || (lower == 0x8000 && (upper & 1))) upper++;
+
+    return upper;
+}
+
+
+unsigned int bfloat16(double d)
+{
+    float f = (float) d;
+    if (std::isnan(d)) return bfloat16(f);
+
+    unsigned int sign = std::signbit(d) ? 0x8000 : 0;
+    double a = std::fabs(d);
+
+    // the tie between the largest bfloat16 and 2^128 rounds to inf
+    if (a >= std::ldexp(2.0 - std::ldexp(1.0, -8), 127)) return sign | 0x7f80;
+    if (a < std::ldexp(1.0, -126))
+    {
+        return sign | (unsigned int) std::nearbyint(std::ldexp(a, 133));
+    }
+
+    int e;
+    std::frexp(a, &e);
+    e--;
+    unsigned int m = std::nearbyint((std::ldexp(a, -e) - 1.0) * 128.0);
+    if (m == 128) { m = 0; e++; }
+
+    return sign | ((e + 127) << 7) | m;
+}
+
+
+float from_bfloat16(unsigned int h)
+{
+    uint32_t x = h << 16;
+    float f;
+    std::memcpy(&f, &x, 4);
+    return f;
+}
+
+
+int matrix_size(int) { return 2; }
+int matrix_size(float) { return 4; }
+int matrix_size(double) { return 8; }
+
+}  // end of namespace ref
+
+
+std::mt19937_64 rng;
+int num_checks = 0;
+int num_failures = 0;
+
+
+void expect(bool ok, const std::string &what, int iter)
+{
+    num_checks++;
+    if (ok) return;
+
+    num_failures++;
+    if (num_failures <= 20)
+    {
+        std::cout << "FAILED: " << what << " (iteration " << iter << ")"
+                  << std::endl;
+    }
+}
+
+
+bool same_bytes(fdcl::serial &buf, const ref::bytes &b)
+{
+    return buf.size() == (int) b.size()
+        && std::memcmp(buf.data(), b.data(), b.size()) == 0;
+}
+
+
+template<typename T>
+bool same_bits(const T &a, const T &b)
+{
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+
+ref::bytes random_bytes(int n)
+{
+    ref::bytes b(n);
+    for(int k = 0; k < n; k++) b[k] = rng();
+    return b;
+}
+
+
+// Random value with a binary exponent in [min_exp, max_exp] and the given
+// number of significand bits. The reference is only defined for zero and
+// normal numbers of the target format, as a negative biased exponent is left
+// shifted, so subnormals, inf and nan are not generated.
+double random_real(int min_exp, int max_exp, int significandbits)
+{
+    double s = (rng() & 1) ? -1.0 : 1.0;
+    int e = min_exp + (int)(rng() % (max_exp - min_exp + 1));
+
+    switch(rng() % 8)
+    {
+        case 0: return 0.0;
+        case 1: return s * std::ldexp(1.0, e);
+        case 2: return s * std::ldexp(2.0 - std::ldexp(1.0, -significandbits),
+            e);
+    }
+
+    unsigned long long int m = rng() & ((1ULL << significandbits) - 1);
+    return s * std::ldexp(1.0 + std::ldexp((double) m, -significandbits), e);
+}
+
+
+double random_value(double) { return random_real(-1022, 1023, 52); }
+float random_value(float) { return random_real(-126, 127, 23); }
+int random_value(int)
+{
+    // the 16 bit float used for int matrices only has a 5 bit exponent
+    return (int)(rng() % 2001) - 1000;
+}
+
+
+void check_scalars(int iter)
+{
+    fdcl::serial buf;
+    ref::bytes b;
+
+    bool vb = rng() & 1;
+    int vi = (int)(rng() % 65536) - 32768;
+    float vf = random_value(0.0f);
+    double vd = random_value(0.0);
+
+    buf.pack(vb);
+    buf.pack(vi);
+    buf.pack(vf);
+    buf.pack(vd);
+    ref::put(b, vb);
+    ref::put(b, vi);
+    ref::put(b, vf);
+    ref::put(b, vd);
+    expect(same_bytes(buf, b), "pack(bool, int, float, double)", iter);
+
+    // round trip of normal numbers is exact
+    fdcl::serial recv(buf.data(), buf.size());
+    bool ub;
+    int ui;
+    float uf;
+    double ud;
+    recv.unpack(ub);
+    recv.unpack(ui);
+    recv.unpack(uf);
+    recv.unpack(ud);
+    expect(ub == vb && ui == vi && same_bits(uf, vf) && same_bits(ud, vd),
+        "round trip (bool, int, float, double)", iter);
+
+    // arbitrary bytes
+    b = random_bytes(14);
+    buf.view(b.data(), b.size());
+    buf.unpack(ui);
+    buf.unpack(uf);
+    buf.unpack(ud);
+
+    float rf;
+    double rd;
+    ref::get(&b[2], rf);
+    ref::get(&b[6], rd);
+    expect(ui == ref::get_i16(&b[0]) && same_bits(uf, rf) && same_bits(ud, rd),
+        "unpack(int, float, double) of random bytes", iter);
+}
+
+
+template<typename Matrix>
+void check_matrix(int iter)
+{
+    typedef typename Matrix::Scalar type;
+    std::ostringstream name;
+    name << "<" << typeid(type).name() << "," << Matrix::RowsAtCompileTime
+         << "," << Matrix::ColsAtCompileTime << ">";
+
+    Matrix M, U;
+    fdcl::serial buf;
+    ref::bytes b;
+    int i, j;
+
+    for(i = 0; i < M.rows(); i++)
+        for(j = 0; j < M.cols(); j++) M(i, j) = random_value(type());
+
+    buf.pack(M);
+    for(i = 0; i < M.rows(); i++)
+        for(j = 0; j < M.cols(); j++) ref::put_matrix(b, M(i, j));
+    expect(same_bytes(buf, b), "pack(Eigen" + name.str() + ")", iter);
+
+    // arbitrary bytes
+    const int n = ref::matrix_size(type());
+    b = random_bytes(M.size() * n);
+    buf.view(b.data(), b.size());
+    buf.unpack(U);
+
+    bool ok = true;
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            type r;
+            ref::get_matrix(&b[(i * M.cols() + j) * n], r);
+            ok = ok && same_bits(U(i, j), r);
+        }
+    }
+    expect(ok, "unpack(Eigen" + name.str() + ") of random bytes", iter);
+}
+
+
+template<typename Matrix>
+void check_as_float(int iter)
+{
+    std::ostringstream name;
+    name << "<" << Matrix::RowsAtCompileTime << ","
+         << Matrix::ColsAtCompileTime << ">";
+
+    Matrix M, U;
+    fdcl::serial buf;
+    ref::bytes b;
+    int i, j;
+
+    // stay below the largest float, so that the cast does not overflow
+    for(i = 0; i < M.rows(); i++)
+        for(j = 0; j < M.cols(); j++) M(i, j) = random_real(-126, 126, 52);
+
+    buf.pack_as_float(M);
+    for(i = 0; i < M.rows(); i++)
+        for(j = 0; j < M.cols(); j++) ref::put(b, (float) M(i, j));
+    expect(same_bytes(buf, b), "pack_as_float" + name.str(), iter);
+
+    b = random_bytes(M.size() * 4);
+    buf.view(b.data(), b.size());
+    buf.unpack_as_double(U);
+
+    bool ok = true;
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = 0; j < M.cols(); j++)
+        {
+            double r = ref::unpack754(ref::get(&b[(i * M.cols() + j) * 4], 4),
+                32, 8);
+            ok = ok && same_bits(U(i, j), r);
+        }
+    }
+    expect(ok, "unpack_as_double" + name.str() + " of random bytes", iter);
+}
+
+
+template<typename Matrix>
+void check_structured(int iter)
+{
+    typedef typename Matrix::Scalar type;
+    std::ostringstream name;
+    name << "<" << typeid(type).name() << "," << Matrix::RowsAtCompileTime
+         << ">";
+
+    Matrix M, U;
+    fdcl::serial buf;
+    ref::bytes b;
+    int i, j;
+
+    for(i = 0; i < M.rows(); i++)
+    {
+        for(j = i; j < M.cols(); j++)
+        {
+            M(i, j) = random_value(type());
+            M(j, i) = M(i, j);
+        }
+    }
+
+    buf.pack_symmetric(M);
+    for(i = 0; i < M.rows(); i++)
+        for(j = i; j < M.cols(); j++) ref::put(b, M(i, j));
+    expect(same_bytes(buf, b), "pack_symmetric" + name.str(), iter);
+
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack_symmetric(U);
+    expect(U == M, "round trip of pack_symmetric" + name.str(), iter);
+}
+
+
+template<typename Matrix>
+void check_diagonal(int iter)
+{
+    std::ostringstream name;
+    name << "<" << Matrix::RowsAtCompileTime << ">";
+
+    Matrix M, U;
+    fdcl::serial buf;
+    ref::bytes b;
+
+    M.setZero();
+    for(int i = 0; i < M.rows(); i++) M(i, i) = random_value(0.0);
+
+    buf.pack_diagonal(M);
+    for(int i = 0; i < M.rows(); i++) ref::put(b, M(i, i));
+    expect(same_bytes(buf, b), "pack_diagonal" + name.str(), iter);
+
+    U.setOnes();
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack_diagonal(U);
+    expect(U == M, "round trip of pack_diagonal" + name.str(), iter);
+}
+
+
+void check_sparse(int iter)
+{
+    int rows = 1 + rng() % 40;
+    int cols = 1 + rng() % 200;
+    int nnz = rng() % (rows * cols / 4 + 1);
+
+    std::vector< Eigen::Triplet<double> > triplets;
+    for(int k = 0; k < nnz; k++)
+    {
+        triplets.push_back(Eigen::Triplet<double>(rng() % rows, rng() % cols,
+            random_value(0.0)));
+    }
+
+    // random values never sum to zero, so duplicates are kept as one entry
+    Eigen::SparseMatrix<double> S(rows, cols), U;
+    S.setFromTriplets(triplets.begin(), triplets.end());
+    S.prune(0.0);
+
+    fdcl::serial buf;
+    buf.pack(S);
+
+    Eigen::SparseMatrix<double, Eigen::RowMajor> R(S);
+    ref::bytes b;
+    ref::put_varint(b, rows);
+    ref::put_varint(b, cols);
+    ref::put_varint(b, R.nonZeros());
+    for(int i = 0; i < rows; i++)
+    {
+        ref::put_varint(b, R.outerIndexPtr()[i + 1] - R.outerIndexPtr()[i]);
+        int j_prev = 0;
+        for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator
+            it(R, i); it; ++it)
+        {
+            ref::put_varint(b, it.col() - j_prev);
+            j_prev = it.col();
+            ref::put(b, it.value());
+        }
+    }
+    expect(same_bytes(buf, b), "pack(SparseMatrix)", iter);
+
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack(U);
+    expect(U.rows() == rows && U.cols() == cols
+        && Eigen::MatrixXd(U) == Eigen::MatrixXd(S),
+        "round trip of pack(SparseMatrix)", iter);
+}
+
+
+void check_quaternion(int iter)
+{
+    Eigen::Quaterniond q(random_value(0.0), random_value(0.0),
+        random_value(0.0), random_value(0.0)), u;
+    fdcl::serial buf;
+    ref::bytes b;
+
+    buf.pack(q);
+    ref::put(b, q.w());
+    ref::put(b, q.x());
+    ref::put(b, q.y());
+    ref::put(b, q.z());
+    expect(same_bytes(buf, b), "pack(Quaterniond)", iter);
+
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack(u);
+    expect(u.coeffs() == q.coeffs(), "round trip of pack(Quaterniond)", iter);
+}
+
+
+#ifdef HAS_X86_TARGET
+__attribute__((target("f16c"))) unsigned int half_f16c(float f)
+{
+    return _cvtss_sh(f, 0);
+}
+
+
+__attribute__((target("f16c"))) float from_half_f16c(unsigned int h)
+{
+    return _cvtsh_ss(h);
+}
+#endif
+
+
+// floats exercising the rounding to 16 bits: a stride over all bit patterns,
+// and the ties between neighboring half precision numbers and their
+// neighbors
+std::vector<float> half_test_values()
+{
+    std::vector<float> values;
+    uint32_t x;
+    float f;
+
+    for(unsigned long long int k = 0; k < (1ULL << 32); k += 509)
+    {
+        x = k;
+        std::memcpy(&f, &x, 4);
+        values.push_back(f);
+    }
+
+    for(unsigned int h = 0; h < 0x7c00; h++)
+    {
+        double a = ref::from_half(h), b = ref::from_half(h + 1);
+        float tie = (a + b) / 2;
+        values.push_back(tie);
+        values.push_back(-tie);
+        values.push_back(std::nextafter(tie, 0.0f));
+        values.push_back(std::nextafter(tie, 1e30f));
+    }
+
+    return values;
+}
+
+
+void check_half(const std::vector<float> &values)
+{
+    fdcl::serial buf;
+    ref::bytes b;
+    size_t k;
+    bool ok;
+
+#ifdef HAS_X86_TARGET
+    // validate the reference itself against the hardware
+    if (__builtin_cpu_supports("f16c"))
+    {
+        ok = true;
+        for(k = 0; k < values.size(); k++)
+            ok = ok && ref::half(values[k]) == half_f16c(values[k]);
+        expect(ok, "reference half against vcvtps2ph", 0);
+
+        ok = true;
+        for(unsigned int h = 0; h < 0x10000; h++)
+        {
+            float f = from_half_f16c(h), r = ref::from_half(h);
+            ok = ok && same_bits(f, r);
+        }
+        expect(ok, "reference half against vcvtph2ps", 0);
+    }
+#endif
+
+    buf.reserve(values.size() * 2);
+    for(k = 0; k < values.size(); k++)
+    {
+        float f = values[k];
+        buf.pack_as_half(f);
+        ref::put(b, ref::half(f), 2);
+    }
+    expect(same_bytes(buf, b), "pack_as_half(float)", 0);
+
+    // all half precision numbers
+    b.clear();
+    for(unsigned int h = 0; h < 0x10000; h++) ref::put(b, h, 2);
+    buf.view(b.data(), b.size());
+
+    ok = true;
+    for(unsigned int h = 0; h < 0x10000; h++)
+    {
+        float f, r = ref::from_half(h);
+        buf.unpack_half(f);
+        ok = ok && same_bits(f, r);
+    }
+    expect(ok, "unpack_half(float) of all half precision numbers", 0);
+}
+
+
+void check_bfloat16(const std::vector<float> &values)
+{
+    fdcl::serial buf;
+    ref::bytes b;
+    size_t k;
+    bool ok;
+
+    buf.reserve(values.size() * 2);
+    for(k = 0; k < values.size(); k++)
+    {
+        float f = values[k];
+        buf.pack_as_bfloat16(f);
+        ref::put(b, ref::bfloat16(f), 2);
+    }
+    expect(same_bytes(buf, b), "pack_as_bfloat16(float)", 0);
+
+    b.clear();
+    for(unsigned int h = 0; h < 0x10000; h++) ref::put(b, h, 2);
+    buf.view(b.data(), b.size());
+
+    ok = true;
+    for(unsigned int h = 0; h < 0x10000; h++)
+    {
+        float f, r = ref::from_bfloat16(h);
+        buf.unpack_bfloat16(f);
+        ok = ok && same_bits(f, r);
+    }
+    expect(ok, "unpack_bfloat16(float) of all bfloat16 numbers", 0);
+}
+
+
+// doubles just above and below every tie between neighboring half precision
+// or bfloat16 numbers, which round to the tie itself as floats
+std::vector<double> near_tie_values()
+{
+    std::vector<double> values;
+    double a, b, tie;
+    unsigned int h;
+
+    for(h = 0; h < 0x7c00; h++)
+    {
+        a = ref::from_half(h);
+        b = ref::from_half(h + 1);
+        tie = (a + b) / 2;
+        values.push_back(std::nextafter(tie, 0.0));
+        values.push_back(std::nextafter(tie, 1e300));
+        values.push_back(tie * (1.0 - std::ldexp(1.0, -40)));
+        values.push_back(tie * (1.0 + std::ldexp(1.0, -40)));
+    }
+
+    for(h = 0; h < 0x7f80; h++)
+    {
+        a = ref::from_bfloat16(h);
+        b = ref::from_bfloat16(h + 1);
+        tie = (a + b) / 2;
+        values.push_back(std::nextafter(tie, 0.0));
+        values.push_back(std::nextafter(tie, 1e300));
+        values.push_back(tie * (1.0 - std::ldexp(1.0, -40)));
+        values.push_back(tie * (1.0 + std::ldexp(1.0, -40)));
+    }
+
+    // beyond the float range
+    values.push_back(1e300);
+    values.push_back(std::ldexp(1.0, -160));
+
+    size_t n = values.size();
+    for(size_t k = 0; k < n; k++) values.push_back(-values[k]);
+
+    return values;
+}
+
+
+void check_near_ties(const std::vector<double> &values)
+{
+    fdcl::serial buf;
+    ref::bytes b;
+    size_t k;
+
+    for(k = 0; k < values.size(); k++)
+    {
+        double d = values[k];
+        buf.pack_as_half(d);
+        ref::put(b, ref::half(d), 2);
+    }
+    expect(same_bytes(buf, b), "pack_as_half(double) near ties", 0);
+
+    buf.clear();
+    b.clear();
+    for(k = 0; k < values.size(); k++)
+    {
+        double d = values[k];
+        buf.pack_as_bfloat16(d);
+        ref::put(b, ref::bfloat16(d), 2);
+    }
+    expect(same_bytes(buf, b), "pack_as_bfloat16(double) near ties", 0);
+}
+
+
+template<typename Matrix>
+void check_as_16(int iter, const std::vector<double> &near_ties)
+{
+    typedef typename Matrix::Scalar type;
+    std::ostringstream name;
+    name << "<" << typeid(type).name() << "," << Matrix::RowsAtCompileTime
+         << ">";
+
+    Matrix M, U, V;
+    fdcl::serial buf;
+    ref::bytes b;
+    int i;
+
+    // half of the elements just off a tie, which only doubles can hold
+    for(i = 0; i < M.size(); i++)
+    {
+        if (rng() & 1) M(i) = random_real(-24, 15, 23);
+        else M(i) = near_ties[rng() % near_ties.size()];
+    }
+
+    buf.pack_as_half(M);
+    buf.pack_as_bfloat16(M);
+    for(i = 0; i < M.size(); i++) ref::put(b, ref::half(M(i)), 2);
+    for(i = 0; i < M.size(); i++) ref::put(b, ref::bfloat16(M(i)), 2);
+    expect(same_bytes(buf, b), "pack_as_half/bfloat16" + name.str(), iter);
+
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack_half(U);
+    recv.unpack_bfloat16(V);
+
+    bool ok = true;
+    for(i = 0; i < M.size(); i++)
+    {
+        ok = ok && same_bits(U(i), (type) ref::from_half(ref::half(M(i))))
+            && same_bits(V(i), (type) ref::from_bfloat16(ref::bfloat16(M(i))));
+    }
+    expect(ok, "unpack_half/bfloat16" + name.str(), iter);
+}
+
+
+template<typename Scalar>
+void check_dynamic(int iter)
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> matrix;
+    std::ostringstream name;
+    name << "<" << typeid(Scalar).name() << ">";
+
+    int rows = rng() % 40, cols = rng() % 300, i, j;
+    matrix M(rows, cols), U;
+    fdcl::serial buf;
+    ref::bytes b;
+
+    for(i = 0; i < rows; i++)
+        for(j = 0; j < cols; j++) M(i, j) = random_value(Scalar());
+
+    buf.pack_dynamic(M);
+    ref::put_varint(b, rows);
+    ref::put_varint(b, cols);
+    for(i = 0; i < rows; i++)
+        for(j = 0; j < cols; j++) ref::put_matrix(b, M(i, j));
+    expect(same_bytes(buf, b), "pack_dynamic" + name.str(), iter);
+
+    fdcl::serial recv(buf.data(), buf.size());
+    recv.unpack_dynamic(U);
+    expect(U.rows() == rows && U.cols() == cols && U == M,
+        "round trip of pack_dynamic" + name.str(), iter);
+
+    // storage large enough is reused
+    std::vector<Scalar> storage;
+    storage.reserve(40 * 300);
+    const Scalar *data = storage.data();
+    recv.init(buf.data(), buf.size());
+    Eigen::Map<matrix> V = recv.unpack_dynamic(storage);
+    expect(V == M && V.data() == data && storage.data() == data,
+        "unpack_dynamic" + name.str() + " into reserved storage", iter);
+
+    // native values behind a one byte prefix are padded to stay aligned
+    bool prefix = true;
+    buf.clear();
+    buf.pack(prefix);
+    buf.pack_native(M);
+
+    recv.init(buf.data(), buf.size());
+    recv.unpack(prefix);
+    recv.unpack_native(U);
+    expect(U.rows() == rows && U.cols() == cols
+        && std::memcmp(U.data(), M.data(), M.size() * sizeof(Scalar)) == 0,
+        "round trip of pack_native" + name.str(), iter);
+
+    recv.init(buf.data(), buf.size());
+    recv.unpack(prefix);
+    Eigen::Map<matrix> W = recv.map_native<Scalar>();
+    expect(W.rows() == rows && W.cols() == cols && W == M
+        && (unsigned char*) W.data() >= recv.data()
+        && (unsigned char*) (W.data() + W.size())
+            <= recv.data() + recv.size(),
+        "map_native" + name.str() + " over the received bytes", iter);
+
+    // unaligned received data is left for unpack_native
+    if (sizeof(Scalar) > 1 && M.size() > 0)
+    {
+        std::vector<Scalar> aligned(buf.size() / sizeof(Scalar) + 2);
+        unsigned char *p = (unsigned char*) aligned.data() + 1;
+        std::memcpy(p, buf.data(), buf.size());
+
+        U.resize(0, 0);
+        recv.view(p, buf.size());
+        recv.unpack(prefix);
+        std::cout.setstate(std::ios::failbit);  // the error message is expected
+        Eigen::Map<matrix> E = recv.map_native<Scalar>();
+        std::cout.clear();
+        recv.unpack_native(U);
+        expect(E.size() == 0 && U.rows() == rows && U.cols() == cols
+            && std::memcmp(U.data(), M.data(), M.size() * sizeof(Scalar)) == 0
+            && recv.loc == (unsigned int) recv.size(),
+            "unpack_native" + name.str() + " after unaligned map_native",
+            iter);
+    }
+}
+
+
+void check_truncated(int iter)
+{
+    // unpacking past the end must leave the variable and the buffer alone
+    fdcl::serial buf;
+    double d = random_value(0.0), u = 1.0;
+
+    buf.pack(d);
+    fdcl::serial recv(buf.data(), 1 + rng() % 7);
+
+    std::cout.setstate(std::ios::failbit);  // the error message is expected
+    recv.unpack(u);
+    std::cout.clear();
+    expect(u == 1.0, "unpack(double) of a truncated buffer", iter);
+}
+
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 500;
+    rng.seed(argc > 2 ? strtoull(argv[2], NULL, 10) : 1);
+
+    std::vector<float> values = half_test_values();
+    check_half(values);
+    check_bfloat16(values);
+
+    std::vector<double> near_ties = near_tie_values();
+    check_near_ties(near_ties);
+
+    for(int iter = 0; iter < iterations; iter++)
+    {
+        check_scalars(iter);
+
+        check_matrix< Eigen::Matrix<double, 3, 1> >(iter);
+        check_matrix< Eigen::Matrix<double, 3, 3> >(iter);
+        check_matrix< Eigen::Matrix<double, 4, 1> >(iter);
+        check_matrix< Eigen::Matrix<double, 6, 1> >(iter);
+        check_matrix< Eigen::Matrix<double, 8, 1> >(iter);
+        check_matrix< Eigen::Matrix<double, 15, 15> >(iter);
+        check_matrix< Eigen::Matrix<int, 4, 1> >(iter);
+        check_matrix< Eigen::Matrix<int, 6, 1> >(iter);
+        check_matrix< Eigen::Matrix<int, 8, 1> >(iter);
+
+        check_as_float< Eigen::Matrix<double, 3, 1> >(iter);
+        check_as_float< Eigen::Matrix<double, 3, 3> >(iter);
+        check_as_float< Eigen::Matrix<double, 4, 1> >(iter);
+        check_as_float< Eigen::Matrix<double, 15, 15> >(iter);
+        check_as_float< Eigen::Matrix<double, 4, 3> >(iter);
+        check_as_float< Eigen::Matrix<double, 6, 1> >(iter);
+        check_as_float< Eigen::Matrix<double, 8, 1> >(iter);
+        check_as_float< Eigen::Matrix<double, 7, 3> >(iter);
+
+        check_structured< Eigen::Matrix<double, 3, 3> >(iter);
+        check_structured< Eigen::Matrix<double, 6, 6> >(iter);
+        check_structured< Eigen::Matrix<double, 15, 15> >(iter);
+        check_structured< Eigen::Matrix<float, 15, 15> >(iter);
+
+        check_diagonal< Eigen::Matrix<double, 3, 3> >(iter);
+        check_diagonal< Eigen::Matrix<double, 6, 6> >(iter);
+        check_diagonal< Eigen::Matrix<double, 15, 15> >(iter);
+
+        check_sparse(iter);
+        check_quaternion(iter);
+        check_as_16< Eigen::Matrix<double, 3, 1> >(iter, near_ties);
+        check_as_16< Eigen::Matrix<double, 6, 1> >(iter, near_ties);
+        check_as_16< Eigen::Matrix<float, 3, 1> >(iter, near_ties);
+        check_as_16< Eigen::Matrix<float, 6, 1> >(iter, near_ties);
+
+        check_dynamic<double>(iter);
+        check_dynamic<float>(iter);
+
+        check_truncated(iter);
+    }
+
+    std::cout << num_checks << " checks, " << num_failures << " failures"
+              << std::endl;
+
+    return num_failures == 0 ? 0 : 1;
+}
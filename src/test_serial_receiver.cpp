@@ -0,0 +1,341 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Eigen/Dense"
+
+#include "fdcl/serial.hpp"
+#include "fdcl/serial_receiver.hpp"
+
+
+// local traffic generator: each sender thread has its own socket, hence its
+// own source address and port, and sends numbered datagrams in batches with
+// sendmmsg, paced to the given rate
+void send_traffic(int fd, int id, int port, int num_packets, double rate)
+{
+	const int batch = 64;
+	int i, k, n;
+	double seq;
+	Eigen::Matrix<double, 6, 1> x;
+	std::vector<fdcl::serial> bufs(batch);
+	std::vector<mmsghdr> msgs(batch);
+	std::vector<iovec> iovs(batch);
+	sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	x.setRandom();
+
+	std::chrono::steady_clock::time_point t0 =
+		std::chrono::steady_clock::now();
+
+	for(i = 0; i < num_packets; i += n)
+	{
+		std::this_thread::sleep_until(t0
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(i / rate)));
+
+		n = std::min(batch, num_packets - i);
+		for(k = 0; k < n; k++)
+		{
+			seq = i + k;
+			bufs[k].clear();
+			bufs[k].pack(id);  // 2 bytes
+			bufs[k].pack(seq); // 8 bytes
+			bufs[k].pack(x);   // 8x6 = 48 bytes
+
+			iovs[k].iov_base = bufs[k].data();
+			iovs[k].iov_len = bufs[k].size();
+
+			memset(&msgs[k], 0, sizeof(mmsghdr));
+			msgs[k].msg_hdr.msg_name = &addr;
+			msgs[k].msg_hdr.msg_namelen = sizeof(addr);
+			msgs[k].msg_hdr.msg_iov = &iovs[k];
+			msgs[k].msg_hdr.msg_iovlen = 1;
+		}
+		sendmmsg(fd, msgs.data(), n, 0);
+	}
+
+	close(fd);
+}
+
+
+// binds one socket per sender on 127.0.0.x, chosen so that each worker gets
+// the same number of senders
+std::vector<int> bind_senders(int num_senders, int num_workers)
+{
+	std::vector<int> fds, per_worker(num_workers, 0);
+	sockaddr_in addr;
+	socklen_t len;
+
+	for(int host = 1; host < 255 && (int) fds.size() < num_senders; host++)
+	{
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + host - 1);
+		addr.sin_port = 0;
+		len = sizeof(addr);
+
+		if (bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0
+			|| getsockname(fd, (sockaddr*) &addr, &len) < 0)
+		{
+			close(fd);
+			continue;
+		}
+
+		int w = fdcl::serial_receiver::worker_of(addr, num_workers);
+		if (per_worker[w] < num_senders / num_workers)
+		{
+			per_worker[w]++;
+			fds.push_back(fd);
+		}
+		else
+		{
+			close(fd);
+		}
+	}
+
+	return fds;
+}
+
+
+// sources that differ only in their address, or only in their port, must be
+// spread evenly over the workers
+bool check_spread(void)
+{
+	const int num_sources = 1024;
+	bool ok = true;
+	sockaddr_in from;
+
+	memset(&from, 0, sizeof(from));
+	from.sin_family = AF_INET;
+
+	for(int num_workers = 2; num_workers <= 8; num_workers++)
+	{
+		for(int by_port = 0; by_port < 2; by_port++)
+		{
+			std::vector<int> count(num_workers, 0);
+			for(int k = 0; k < num_sources; k++)
+			{
+				// e.g., 192.168.1.1, 192.168.1.5, ... on port 5000
+				from.sin_addr.s_addr = htonl(by_port ? 0xc0a80101u
+					: 0xc0a80101u + 4 * k);
+				from.sin_port = htons(by_port ? 5000 + 4 * k : 5000);
+				count[fdcl::serial_receiver::worker_of(from, num_workers)]++;
+			}
+
+			int fair = num_sources / num_workers;
+			for(int i = 0; i < num_workers; i++)
+			{
+				if (count[i] < fair * 3 / 4 || count[i] > fair * 5 / 4)
+				{
+					std::cout << "FAILED: worker " << i << " of " << num_workers
+					          << " gets " << count[i] << " of " << num_sources
+					          << " sources differing by "
+					          << (by_port ? "port" : "address") << std::endl;
+					ok = false;
+				}
+			}
+		}
+	}
+
+	return ok;
+}
+
+
+// Usage: test_serial_receiver [rate]
+// Sends 400000 datagrams from 8 sources at the given total rate, and checks
+// that the pipeline unpacks all of them, in order, spread over the workers.
+// By default, 125000 datagrams/s are offered and the pipeline must unpack at
+// least 100000 of them per second. On a single CPU, the senders compete with
+// the receiver, so only 50000 datagrams/s are offered and the rate is only
+// reported.
+// open rejects sizes that would leave the receiver without slots
+bool check_open_arguments(void)
+{
+	fdcl::serial_receiver receiver;
+	auto handler = [](const sockaddr_in &from, fdcl::serial &buf) {};
+	bool ok = true;
+
+	std::cout.setstate(std::ios::failbit);  // the error messages are expected
+	ok = ok && !receiver.open(0, 1, handler, 0);
+	ok = ok && !receiver.open(0, 1, handler, -1);
+	ok = ok && !receiver.open(0, 1, handler, 16, 0);
+	ok = ok && !receiver.open(0, 1, handler, 16, 256, 0);
+	ok = ok && !receiver.open(0, 1, handler, 16, 256, -4);
+	std::cout.clear();
+
+	if (!ok) std::cout << "FAILED: open accepts non-positive sizes" << std::endl;
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	if (!check_spread() || !check_open_arguments()) return 1;
+
+	const int num_senders = 8;
+	const int num_packets = 50000;
+	const int num_workers = 4;
+	const double target_rate = 100000.0;
+	const bool single_cpu = std::thread::hardware_concurrency() < 2;
+	const double rate = argc > 1 ? atof(argv[1])
+		: single_cpu ? 50000.0 : 125000.0;
+
+	std::vector<double> last_seq(num_senders, -1.0);
+	std::atomic<unsigned long long int> decoded(0), out_of_order(0);
+	std::atomic<long long int> t_last(0);
+	int failures = 0;
+
+	fdcl::serial_receiver receiver;
+
+	// each sender is mapped to a single worker, so last_seq[id] is only
+	// touched by one thread
+	auto handler = [&](const sockaddr_in &from, fdcl::serial &buf)
+	{
+		int id;
+		double seq;
+		Eigen::Matrix<double, 6, 1> x;
+
+		buf.unpack(id);
+		buf.unpack(seq);
+		buf.unpack(x);
+
+		if (id < 0 || id >= num_senders || seq <= last_seq[id])
+		{
+			out_of_order++;
+		}
+		else
+		{
+			last_seq[id] = seq;
+		}
+
+		decoded++;
+		t_last = std::chrono::steady_clock::now().time_since_epoch().count();
+	};
+
+	std::vector<int> fds = bind_senders(num_senders, num_workers);
+	if ((int) fds.size() != num_senders)
+	{
+		std::cout << "FAILED: could not bind " << num_senders << " senders"
+		          << std::endl;
+		return 1;
+	}
+
+	if (!receiver.open(0, num_workers, handler, 8192, 256, 64, 4 << 20))
+	{
+		return 1;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> senders;
+	for(int i = 0; i < num_senders; i++)
+	{
+		senders.push_back(std::thread(send_traffic, fds[i], i,
+			receiver.port(), num_packets, rate / num_senders));
+	}
+	for(size_t i = 0; i < senders.size(); i++) senders[i].join();
+
+	// wait for the pipeline to drain, i.e., no slot in flight and nothing
+	// new received for a while, for at most 10 s
+	fdcl::serial_receiver::stats s = receiver.get_stats();
+	unsigned long long int last_received = s.received + 1;
+	bool drained = false;
+	for(int k = 0; k < 200 && !drained; k++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		s = receiver.get_stats();
+		drained = s.slots_in_flight == 0 && s.received == last_received;
+		last_received = s.received;
+	}
+	receiver.close();
+
+	double elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::duration(t_last) - t0.time_since_epoch())
+		.count();
+	unsigned long long int sent = (unsigned long long int) num_senders
+		* num_packets;
+	double decode_rate = decoded / elapsed;
+
+	std::cout << "sent         = " << sent << " (" << rate
+	          << " packets/s offered)" << std::endl;
+	std::cout << "received     = " << s.received << std::endl;
+	std::cout << "decoded      = " << decoded << std::endl;
+	std::cout << "dropped      = " << s.dropped << std::endl;
+	std::cout << "truncated    = " << s.truncated << std::endl;
+	std::cout << "out of order = " << out_of_order << std::endl;
+	std::cout << "batches      = " << s.batches << " ("
+	          << (double) s.received / s.batches << " datagrams/batch)"
+	          << std::endl;
+	std::cout << "in flight    = " << s.slots_in_flight << " (max "
+	          << s.slots_in_flight_max << ")" << std::endl;
+	for(size_t i = 0; i < s.processed.size(); i++)
+	{
+		std::cout << "worker " << i << "     = " << s.processed[i]
+		          << " decoded, queue depth " << s.queue_depth[i]
+		          << " (max " << s.queue_depth_max[i] << ")" << std::endl;
+	}
+	std::cout << "rate         = " << decode_rate << " packets/s (target "
+	          << target_rate << ")" << std::endl;
+
+	if (!drained)
+	{
+		std::cout << "FAILED: pipeline did not drain" << std::endl;
+		failures++;
+	}
+	if (decoded != s.received || s.received != sent || s.dropped != 0)
+	{
+		std::cout << "FAILED: " << sent - decoded << " datagrams lost"
+		          << std::endl;
+		failures++;
+	}
+	if (out_of_order != 0)
+	{
+		std::cout << "FAILED: datagrams unpacked out of order" << std::endl;
+		failures++;
+	}
+	for(size_t i = 0; i < s.processed.size(); i++)
+	{
+		// every worker serves the same number of senders
+		if (s.processed[i] != sent / num_workers)
+		{
+			std::cout << "FAILED: worker " << i << " unpacked "
+			          << s.processed[i] << " instead of " << sent / num_workers
+			          << std::endl;
+			failures++;
+		}
+		if (s.queue_depth[i] != 0)
+		{
+			std::cout << "FAILED: worker " << i << " reports a queue depth of "
+			          << s.queue_depth[i] << " after draining" << std::endl;
+			failures++;
+		}
+	}
+	if (single_cpu)
+	{
+		std::cout << "rate not checked, the senders share a single CPU with "
+		          << "the receiver" << std::endl;
+	}
+	else if (decode_rate < target_rate)
+	{
+		std::cout << "FAILED: below " << target_rate << " packets/s"
+		          << std::endl;
+		failures++;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
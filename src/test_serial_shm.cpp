@@ -0,0 +1,185 @@
+#include <iostream>
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "fdcl/serial.hpp"
+#include "fdcl/serial_shm.hpp"
+
+
+int failures = 0;
+
+
+void expect(bool ok, const std::string &what)
+{
+	if (!ok)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+
+// a message larger than the slot is not published with stale bytes
+void check_overflow(const std::string &name)
+{
+	const int num_slots = 4, slot_size = 64;
+	fdcl::serial_shm writer, reader;
+	fdcl::serial buf;
+	double d = 1.0, d_recv = 0.0;
+	int i;
+
+	expect(writer.open(name, num_slots, slot_size), "open writer");
+	expect(reader.open(name, num_slots, slot_size), "open reader");
+
+	writer.claim(buf);
+	for(i = 0; i < 10; i++) buf.pack(d);  // 80 bytes
+	expect(buf.overflow(), "overflow is recorded");
+	expect(!writer.publish(buf), "publish refuses an oversized message");
+	expect(!buf.overflow(), "overflow is reset after publish");
+
+	d = 2.0;
+	writer.claim(buf);
+	buf.pack(d);
+	expect(writer.publish(buf), "publish after an oversized message");
+
+	expect(reader.read(buf, 100), "read after an oversized message");
+	buf.unpack(d_recv);
+	expect(buf.size() == 8 && d_recv == 2.0,
+		"oversized message is skipped by the reader");
+	expect(reader.release(), "release after an oversized message");
+	expect(reader.lost() == 1, "oversized message is counted as lost");
+
+	fdcl::serial_shm::unlink(name);
+}
+
+
+// publishes the given sequence numbers, one message each
+void publish_range(fdcl::serial_shm &writer, int first, int last)
+{
+	fdcl::serial buf;
+
+	for(int seq = first; seq < last; seq++)
+	{
+		writer.claim(buf);
+		buf.pack(seq);
+		writer.publish(buf);
+	}
+}
+
+
+// a reader more than a ring behind skips to the oldest message
+void check_lapped(const std::string &name)
+{
+	const int num_slots = 8;
+	fdcl::serial_shm writer, reader;
+	fdcl::serial buf;
+	int seq, expected;
+	bool in_order = true;
+
+	expect(writer.open(name, num_slots, 64), "open writer");
+	expect(reader.open(name, num_slots, 64), "open reader");
+
+	publish_range(writer, 0, num_slots + 5);
+
+	for(expected = 5; expected < num_slots + 5; expected++)
+	{
+		if (!reader.read(buf, 100)) break;
+		buf.unpack(seq);
+		if (!reader.release() || seq != expected) in_order = false;
+	}
+	expect(expected == num_slots + 5 && in_order,
+		"lapped reader reads the last ring in order");
+	expect(reader.lost() == 5, "lapped reader counts the skipped messages");
+
+	fdcl::serial_shm::unlink(name);
+}
+
+
+// a message overwritten while it is being unpacked is reported by release
+void check_overwritten(const std::string &name)
+{
+	const int num_slots = 4;
+	fdcl::serial_shm writer, reader;
+	fdcl::serial buf;
+	int seq = -1;
+
+	expect(writer.open(name, num_slots, 64), "open writer");
+	expect(reader.open(name, num_slots, 64), "open reader");
+
+	publish_range(writer, 0, 1);
+	expect(reader.read(buf, 100), "read before overwriting");
+
+	// the writer reuses the slot of message 0
+	publish_range(writer, 1, num_slots + 1);
+	buf.unpack(seq);
+	expect(!reader.release(), "release fails on an overwritten message");
+
+	expect(reader.read(buf, 100), "read after an overwritten message");
+	buf.unpack(seq);
+	expect(reader.release() && seq == 1,
+		"reader continues with the oldest message");
+
+	fdcl::serial_shm::unlink(name);
+}
+
+
+// read returns false once the timeout expires without a message
+void check_timeout(const std::string &name)
+{
+	fdcl::serial_shm reader;
+	fdcl::serial buf;
+
+	expect(reader.open(name, 4, 64), "open reader");
+
+	std::chrono::steady_clock::time_point t0 =
+		std::chrono::steady_clock::now();
+	bool received = reader.read(buf, 50);
+	double elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - t0).count();
+
+	expect(!received, "read times out without a message");
+	expect(elapsed >= 0.045, "read waits for the timeout");
+
+	fdcl::serial_shm::unlink(name);
+}
+
+
+// all processes must agree on the number and size of slots
+void check_mismatch(const std::string &name)
+{
+	fdcl::serial_shm first, other;
+
+	expect(first.open(name, 8, 256), "open ring");
+	expect(!other.open(name, 16, 256), "mismatched number of slots");
+	expect(!other.open(name, 8, 512), "mismatched slot size");
+
+	// same total size, different layout
+	expect(!other.open(name, 4, 576), "mismatched layout of slots");
+
+	expect(other.open(name, 8, 256), "matching number and size of slots");
+
+	fdcl::serial_shm::unlink(name);
+}
+
+
+int main(void)
+{
+	std::ostringstream name;
+	name << "/fdcl_test_shm_" << getpid();
+
+	fdcl::serial_shm::unlink(name.str());
+
+	check_overflow(name.str());
+	check_lapped(name.str());
+	check_overwritten(name.str());
+	check_timeout(name.str());
+	check_mismatch(name.str());
+
+	fdcl::serial_shm::unlink(name.str());
+
+	if (failures == 0) std::cout << "all checks passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}